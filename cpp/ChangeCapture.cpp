@@ -0,0 +1,176 @@
+#include "ChangeCapture.h"
+#include "bridge.h"
+#include <algorithm>
+#include <stdexcept>
+#include <strings.h>
+
+namespace opsqlite {
+
+ChangeCapture::ChangeCapture(sqlite3 *db, size_t capacity,
+                             std::vector<ChangeCaptureFilter> const &filters)
+    : has_filters(!filters.empty()), ring(capacity > 0 ? capacity : 1) {
+  for (const auto &filter : filters) {
+    bool has_hidden = false;
+    auto names =
+        opsqlite_get_table_columns(db, "main", filter.table, &has_hidden);
+    if (names.empty()) {
+      throw std::runtime_error("[op-sqlite][changeHook] table " +
+                               filter.table + " does not exist");
+    }
+
+    // Generated columns do not line up with the preupdate hook columns
+    if (has_hidden && !filter.columns.empty()) {
+      throw std::runtime_error("[op-sqlite][changeHook] columns of " +
+                               filter.table +
+                               " cannot be picked, it has generated columns");
+    }
+
+    Table &table = tables[table_id(filter.table.c_str())];
+    table.is_captured = true;
+
+    for (const auto &column : filter.columns) {
+      size_t index = 0;
+      while (index < names.size() &&
+             strcasecmp(names[index].c_str(), column.c_str()) != 0) {
+        index++;
+      }
+
+      if (index == names.size()) {
+        throw std::runtime_error("[op-sqlite][changeHook] column " + column +
+                                 " does not exist on " + filter.table);
+      }
+
+      table.indexes.push_back(static_cast<int>(index));
+      table.names.push_back(names[index]);
+    }
+  }
+}
+
+size_t ChangeCapture::table_id(char const *table) {
+  if (last_table == table) {
+    return last_table_id;
+  }
+
+  auto [it, inserted] = table_ids.try_emplace(table, tables.size());
+  if (inserted) {
+    tables.push_back(Table{.name = table, .is_captured = !has_filters});
+  }
+
+  last_table = table;
+  last_table_id = it->second;
+  return last_table_id;
+}
+
+void ChangeCapture::capture(sqlite3 *db, int operation, char const *table,
+                            sqlite3_int64 old_row_id,
+                            sqlite3_int64 new_row_id) {
+  size_t id = table_id(table);
+  const Table &captured_table = tables[id];
+  if (!captured_table.is_captured) {
+    return;
+  }
+
+  // Overwrite the oldest change once the buffer is full
+  size_t slot = (start + size) % ring.size();
+  if (size == ring.size()) {
+    start = (start + 1) % ring.size();
+    dropped++;
+  } else {
+    size++;
+  }
+
+  CapturedChange &change = ring[slot];
+  change.table_id = id;
+  change.operation = operation;
+  change.row_id = static_cast<double>(
+      operation == SQLITE_DELETE ? old_row_id : new_row_id);
+  change.old_values.clear();
+  change.new_values.clear();
+
+  if (operation != SQLITE_INSERT) {
+    read_values(db, captured_table, true, change.old_values);
+  }
+  if (operation != SQLITE_DELETE) {
+    read_values(db, captured_table, false, change.new_values);
+  }
+}
+
+void ChangeCapture::read_values(sqlite3 *db, const Table &table, bool is_old,
+                                std::vector<JSVariant> &values) {
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+  int column_count = sqlite3_preupdate_count(db);
+  size_t count =
+      table.indexes.empty() ? column_count : table.indexes.size();
+
+  for (size_t i = 0; i < count; i++) {
+    int index = table.indexes.empty() ? static_cast<int>(i) : table.indexes[i];
+    sqlite3_value *value = nullptr;
+
+    if (index < column_count) {
+      if (is_old) {
+        sqlite3_preupdate_old(db, index, &value);
+      } else {
+        sqlite3_preupdate_new(db, index, &value);
+      }
+    }
+
+    values.push_back(opsqlite_value_to_variant(value));
+  }
+#endif
+}
+
+ChangeBatch ChangeCapture::take() {
+  ChangeBatch batch;
+  batch.dropped = dropped;
+  batch.changes.reserve(size);
+
+  for (size_t i = 0; i < size; i++) {
+    batch.changes.push_back(std::move(ring[(start + i) % ring.size()]));
+  }
+
+  discard();
+  return batch;
+}
+
+void ChangeCapture::discard() {
+  start = 0;
+  size = 0;
+  dropped = 0;
+}
+
+void ChangeCapture::truncate(size_t position) {
+  if (position >= dropped + size) {
+    return;
+  }
+
+  // Changes overwritten after the savepoint were undone as well
+  if (position <= dropped) {
+    dropped = position;
+    size = 0;
+    return;
+  }
+
+  size = position - dropped;
+}
+
+void ChangeCapture::resolve_columns(sqlite3 *db, ChangeBatch &batch) {
+  for (const auto &change : batch.changes) {
+    Table &table = tables[change.table_id];
+    size_t value_count =
+        std::max(change.old_values.size(), change.new_values.size());
+
+    // Every column is captured, looked up again when a migration added some
+    if (table.indexes.empty() && table.names.size() < value_count) {
+      table.names = opsqlite_get_table_columns(db, "main", table.name);
+    }
+  }
+
+  batch.tables.reserve(tables.size());
+  batch.columns.reserve(tables.size());
+  for (const auto &table : tables) {
+    batch.tables.push_back(table.name);
+    batch.columns.push_back(table.names);
+  }
+}
+
+} // namespace opsqlite
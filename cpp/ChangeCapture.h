@@ -0,0 +1,98 @@
+#pragma once
+
+#include "types.h"
+#include <sqlite3.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace opsqlite {
+
+// Changes kept for a transaction when no size is given
+#define DEFAULT_CHANGE_CAPTURE_SIZE 10000
+
+/// Table to capture and the columns to keep, all of them when empty
+struct ChangeCaptureFilter {
+  std::string table;
+  std::vector<std::string> columns;
+};
+
+/// A row change seen by the preupdate hook, with the values of the captured
+/// columns. DELETEs have no new values and INSERTs no old ones
+struct CapturedChange {
+  size_t table_id;
+  // SQLITE_INSERT, SQLITE_DELETE or SQLITE_UPDATE
+  int operation;
+  double row_id;
+  std::vector<JSVariant> old_values;
+  std::vector<JSVariant> new_values;
+};
+
+/// Changes of a committed transaction, ready to be sent to JS
+struct ChangeBatch {
+  std::vector<CapturedChange> changes;
+  // Indexed by table id
+  std::vector<std::string> tables;
+  // Names of the captured columns of each table, in the order of the values
+  std::vector<std::vector<std::string>> columns;
+  // Oldest changes overwritten because the transaction did not fit
+  size_t dropped = 0;
+};
+
+/// Change data capture feed built on the preupdate hook. Changes are written
+/// to a ring buffer as the transaction runs and taken out when it commits.
+/// Everything but the constructor runs on the database thread
+class ChangeCapture {
+public:
+  /// Resolves the column names of the filters, throws if a table or a column
+  /// does not exist. Every table is captured when there are no filters
+  ChangeCapture(sqlite3 *db, size_t capacity,
+                std::vector<ChangeCaptureFilter> const &filters);
+
+  /// Called from the preupdate hook
+  void capture(sqlite3 *db, int operation, char const *table,
+               sqlite3_int64 old_row_id, sqlite3_int64 new_row_id);
+  bool empty() const { return size == 0; }
+  /// Moves the changes out of the ring buffer, oldest first
+  ChangeBatch take();
+  /// Forgets the changes of a transaction that rolled back
+  void discard();
+  /// Changes captured since the transaction began, overwritten ones included
+  size_t position() const { return dropped + size; }
+  /// Forgets the changes captured after position, undone by a ROLLBACK TO
+  void truncate(size_t position);
+  /// Fills the column names of the batch. Runs the table_xinfo pragma, so it
+  /// cannot be called from a hook
+  void resolve_columns(sqlite3 *db, ChangeBatch &batch);
+
+private:
+  struct Table {
+    std::string name;
+    bool is_captured;
+    // Captured columns, every column of the table when empty
+    std::vector<int> indexes;
+    // Names of the captured columns, looked up on the first commit when
+    // every column is captured
+    std::vector<std::string> names;
+  };
+
+  size_t table_id(char const *table);
+  void read_values(sqlite3 *db, const Table &table, bool is_old,
+                   std::vector<JSVariant> &values);
+
+  bool has_filters;
+  std::vector<Table> tables;
+  std::unordered_map<std::string, size_t> table_ids;
+  // Rows of a statement usually hit the same table
+  std::string last_table;
+  size_t last_table_id = 0;
+
+  // Allocated once, a transaction writing more changes than it holds
+  // overwrites the oldest ones
+  std::vector<CapturedChange> ring;
+  size_t start = 0;
+  size_t size = 0;
+  size_t dropped = 0;
+};
+
+} // namespace opsqlite
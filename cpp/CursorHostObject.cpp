@@ -0,0 +1,146 @@
+#include "CursorHostObject.h"
+#include "bridge.h"
+#include "macros.h"
+#include "utils.h"
+
+namespace opsqlite {
+
+namespace jsi = facebook::jsi;
+
+std::vector<jsi::PropNameID>
+CursorHostObject::getPropertyNames(jsi::Runtime &rt) {
+  std::vector<jsi::PropNameID> keys;
+
+  return keys;
+}
+
+jsi::Value CursorHostObject::get(jsi::Runtime &rt,
+                                 const jsi::PropNameID &propNameID) {
+  auto name = propNameID.utf8(rt);
+
+  if (name == "next") {
+    return HOSTFN("next") {
+      size_t chunk_size = 100;
+      if (count > 0 && args[0].isNumber()) {
+        double requested = args[0].asNumber();
+        if (requested < 1) {
+          throw std::runtime_error(
+              "[op-sqlite][next] count must be a positive number");
+        }
+        chunk_size = static_cast<size_t>(requested);
+      }
+
+      auto &promiseCtr = _js_call_invoker->get_promise_constructor();
+      auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
+        auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
+        auto reject = std::make_shared<jsi::Value>(rt, args[1]);
+
+        auto task = [&rt, self = shared_from_this(), resolve, reject, chunk_size,
+                     invoker = this->_js_call_invoker]() {
+          try {
+            // The statement can still be finalized after the connection
+            // closed, it cannot be stepped
+            if (*self->_is_db_closed) {
+              throw std::runtime_error("[op-sqlite][next] database is closed");
+            }
+
+            auto status = BridgeResult{.affectedRows = 0, .insertId = 0};
+            bool done = self->_done;
+
+            if (!done && self->_stmt == nullptr) {
+              self->_stmt = opsqlite_prepare_statement(self->_db, self->_query);
+              opsqlite_bind_statement(self->_stmt, &self->_params);
+
+              int column_count = sqlite3_column_count(self->_stmt);
+              for (int i = 0; i < column_count; i++) {
+                self->_column_names.emplace_back(
+                    sqlite3_column_name(self->_stmt, i));
+              }
+            }
+
+            if (!done) {
+              done = opsqlite_step_statement(self->_db, self->_stmt, chunk_size,
+                                             &status.rows);
+            }
+
+            // Release the statement as soon as it is exhausted, there is no
+            // guarantee the JS side will call close
+            if (done) {
+              self->finalize();
+            }
+
+            status.column_names = self->_column_names;
+
+            invoker->invokeAsync([&rt, status = std::move(status), done,
+                                  resolve] {
+              auto res = create_js_rows(rt, status);
+              res.asObject(rt).setProperty(rt, "done", done);
+              resolve->asObject(rt).asFunction(rt).call(rt, std::move(res));
+            });
+          } catch (std::exception &exc) {
+            self->finalize();
+            invoker->invokeAsync([&rt, message = std::string(exc.what()),
+                                  reject] {
+              auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
+              auto error = errorCtr.callAsConstructor(
+                  rt, jsi::String::createFromUtf8(rt, message));
+              reject->asObject(rt).asFunction(rt).call(rt, error);
+            });
+          }
+        };
+
+        _queue->queueWork(task);
+
+        return {};
+      }));
+
+      return promise;
+    });
+  }
+
+  if (name == "close") {
+    return HOSTFN("close") {
+      auto &promiseCtr = _js_call_invoker->get_promise_constructor();
+      auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
+        auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
+
+        // Goes through the queue so pending calls to next finish first
+        auto task = [&rt, self = shared_from_this(), resolve,
+                     invoker = this->_js_call_invoker]() {
+          self->finalize();
+          invoker->invokeAsync([&rt, resolve] {
+            resolve->asObject(rt).asFunction(rt).call(rt, {});
+          });
+        };
+
+        _queue->queueWork(task);
+
+        return {};
+      }));
+
+      return promise;
+    });
+  }
+
+  return {};
+}
+
+void CursorHostObject::finalize() {
+  _done = true;
+  if (_stmt != nullptr) {
+    sqlite3_finalize(_stmt);
+    _stmt = nullptr;
+  }
+}
+
+CursorHostObject::~CursorHostObject() {
+  if (_stmt == nullptr) {
+    return;
+  }
+
+  // Collected on any thread, the statement is only touched on the database
+  // thread
+  _queue->queueWork([stmt = _stmt] { sqlite3_finalize(stmt); });
+}
+
+} // namespace opsqlite
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "JSCallInvoker.h"
+#include "ThreadPool.h"
+#include "types.h"
+#include <atomic>
+#include <jsi/jsi.h>
+#include <memory>
+#include <sqlite3.h>
+#include <string>
+#include <vector>
+
+namespace opsqlite {
+
+namespace jsi = facebook::jsi;
+namespace react = facebook::react;
+
+/// Keeps a statement open on the database thread and hands its rows to JS in
+/// chunks, so large results never need to be fully materialized
+class CursorHostObject : public jsi::HostObject,
+                         public std::enable_shared_from_this<CursorHostObject> {
+public:
+  CursorHostObject(sqlite3 *db, std::string query,
+                   std::vector<JSVariant> params,
+                   std::shared_ptr<JSCallInvoker> js_call_invoker,
+                   std::shared_ptr<SerialQueue> queue,
+                   std::shared_ptr<std::atomic<bool>> is_db_closed)
+      : _db(db), _query(std::move(query)), _params(std::move(params)),
+        _js_call_invoker(std::move(js_call_invoker)),
+        _queue(std::move(queue)), _is_db_closed(std::move(is_db_closed)) {};
+  ~CursorHostObject() override;
+
+  std::vector<jsi::PropNameID> getPropertyNames(jsi::Runtime &rt) override;
+
+  jsi::Value get(jsi::Runtime &rt, const jsi::PropNameID &propNameID) override;
+
+private:
+  // Only called from the database thread
+  void finalize();
+
+  sqlite3 *_db;
+  std::string _query;
+  std::vector<JSVariant> _params;
+  // Prepared lazily on the first call to next
+  sqlite3_stmt *_stmt = nullptr;
+  std::vector<std::string> _column_names;
+  bool _done = false;
+  std::shared_ptr<JSCallInvoker> _js_call_invoker;
+  std::shared_ptr<SerialQueue> _queue;
+  // Set by the database once it is closed, _db must not be used anymore
+  std::shared_ptr<std::atomic<bool>> _is_db_closed;
+};
+
+} // namespace opsqlite
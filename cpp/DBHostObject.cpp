@@ -1,14 +1,26 @@
 #include "DBHostObject.h"
 #include "PreparedStatementHostObject.h"
+#include "QueryCancellation.h"
+#include "ResultSetHostObject.h"
 #if OP_SQLITE_USE_LIBSQL
 #include "libsql/bridge.h"
 #else
+#include "ChangeCapture.h"
+#include "CursorHostObject.h"
+#include "SessionHostObject.h"
+#include "TransactionHostObject.h"
 #include "bridge.h"
 #endif
 #include "logs.h"
 #include "macros.h"
 #include "utils.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <iostream>
+#include <string_view>
+#include <strings.h>
+#include <unordered_set>
 #include <utility>
 
 namespace opsqlite {
@@ -25,104 +37,820 @@ void DBHostObject::flush_pending_reactive_queries(
 #else
 void DBHostObject::flush_pending_reactive_queries(
     const std::shared_ptr<jsi::Value> &resolve) {
-  for (const auto &query_ptr : pending_reactive_queries) {
-    auto query = query_ptr.get();
+  for (size_t id : dirty_reactive_tables) {
+    auto &reactive_table = reactive_tables[id];
 
-    std::vector<DumbHostObject> results;
-    std::shared_ptr<std::vector<SmartHostObject>> metadata =
-        std::make_shared<std::vector<SmartHostObject>>();
+    for (const auto &subscription : reactive_table.table_subscriptions) {
+      if (reactive_table.rows_changed ||
+          (subscription.columns & reactive_table.changed_columns) != 0) {
+        queue_reactive_query(subscription.query);
+      }
+    }
+
+    reactive_table.changed_columns = 0;
+    reactive_table.rows_changed = false;
+  }
+  dirty_reactive_tables.clear();
+
+  for (const auto &query : pending_reactive_queries) {
+    query->is_pending = false;
+
+    // An explicit flush does not wait for the window
+    if (resolve == nullptr && query->coalesce_ms > 0) {
+      schedule_reactive_query(query);
+    } else {
+      run_reactive_query(query);
+    }
+  }
+
+  pending_reactive_queries.clear();
+
+  // Flushed by a commit, nobody is waiting
+  if (resolve == nullptr) {
+    return;
+  }
+
+  invoker->invokeAsync(
+      [this, resolve]() { resolve->asObject(rt).asFunction(rt).call(rt, {}); });
+}
+
+static bool is_same_value(const JSVariant &a, const JSVariant &b) {
+  if (a.index() != b.index()) {
+    return false;
+  }
+
+  if (std::holds_alternative<ArrayBuffer>(a)) {
+    auto &buffer_a = std::get<ArrayBuffer>(a);
+    auto &buffer_b = std::get<ArrayBuffer>(b);
+    return buffer_a.size == buffer_b.size &&
+           memcmp(buffer_a.data.get(), buffer_b.data.get(), buffer_a.size) ==
+               0;
+  }
+
+  return std::visit(
+      [&b](const auto &value) {
+        using T = std::decay_t<decltype(value)>;
+        if constexpr (std::is_same_v<T, ArrayBuffer>) {
+          return false;
+        } else {
+          return value == std::get<T>(b);
+        }
+      },
+      a);
+}
+
+static bool is_same_row(const std::vector<JSVariant> &a,
+                        const std::vector<JSVariant> &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < a.size(); i++) {
+    if (!is_same_value(a[i], b[i])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/// Hashable form of a key, the type is part of it so 1 and '1' differ
+static std::string to_key(const JSVariant &value) {
+  std::string key(1, static_cast<char>(value.index()));
+
+  if (std::holds_alternative<double>(value)) {
+    double number = std::get<double>(value);
+    key.append(reinterpret_cast<const char *>(&number), sizeof(number));
+  } else if (std::holds_alternative<std::string>(value)) {
+    key += std::get<std::string>(value);
+  } else if (std::holds_alternative<ArrayBuffer>(value)) {
+    auto &buffer = std::get<ArrayBuffer>(value);
+    key.append(reinterpret_cast<const char *>(buffer.data.get()), buffer.size);
+  }
+
+  return key;
+}
+
+void DBHostObject::run_reactive_query(
+    const std::shared_ptr<ReactiveQuery> &query) {
+  std::vector<DumbHostObject> results;
+  std::shared_ptr<std::vector<SmartHostObject>> metadata =
+      std::make_shared<std::vector<SmartHostObject>>();
 
-    auto status = opsqlite_execute_prepared_statement(db, query->stmt, &results,
-                                                      metadata);
+  auto status =
+      opsqlite_execute_prepared_statement(db, query->stmt, &results, metadata);
+
+  std::vector<std::vector<JSVariant>> rows;
+  rows.reserve(results.size());
+  for (const auto &row : results) {
+    rows.push_back(row.values);
+  }
+
+  if (query->key_column < 0) {
+    // Nothing visible changed, e.g. the updated rows are filtered out
+    bool is_unchanged =
+        query->has_emitted && rows.size() == query->last_rows.size() &&
+        std::equal(rows.begin(), rows.end(), query->last_rows.begin(),
+                   is_same_row);
+    query->has_emitted = true;
+    query->last_rows = std::move(rows);
+
+    if (is_unchanged) {
+      return;
+    }
 
     invoker->invokeAsync(
-        [this, results = std::make_shared<std::vector<DumbHostObject>>(results),
+        [this,
+         results = std::make_shared<std::vector<DumbHostObject>>(
+             std::move(results)),
          callback = query->callback, metadata, status = std::move(status)] {
           auto jsiResult = create_result(rt, status, results.get(), metadata);
           callback->asObject(rt).asFunction(rt).call(rt, jsiResult);
         });
+    return;
   }
 
-  pending_reactive_queries.clear();
+  size_t key_column = query->key_column;
+  std::vector<std::string> keys;
+  keys.reserve(rows.size());
+  std::unordered_set<std::string_view> seen;
+  seen.reserve(rows.size());
+  for (const auto &row : rows) {
+    keys.push_back(to_key(row[key_column]));
+
+    // Rows sharing a key cannot be told apart, the last valid result is kept
+    // to diff the next one against
+    if (!seen.insert(keys.back()).second) {
+      LOGE("[op-sqlite][reactiveExecute] the key column has duplicate values, "
+           "the result is not sent");
+      return;
+    }
+  }
 
-  invoker->invokeAsync(
-      [this, resolve]() { resolve->asObject(rt).asFunction(rt).call(rt, {}); });
+  std::unordered_map<std::string, size_t> previous;
+  previous.reserve(query->last_rows.size());
+  for (size_t i = 0; i < query->last_rows.size(); i++) {
+    previous.emplace(to_key(query->last_rows[i][key_column]), i);
+  }
+
+  auto inserted = std::make_shared<std::vector<DumbHostObject>>();
+  auto updated = std::make_shared<std::vector<DumbHostObject>>();
+  auto removed = std::make_shared<std::vector<JSVariant>>();
+
+  for (size_t i = 0; i < results.size(); i++) {
+    auto it = previous.find(keys[i]);
+
+    if (it == previous.end()) {
+      inserted->push_back(std::move(results[i]));
+      continue;
+    }
+
+    if (!is_same_row(rows[i], query->last_rows[it->second])) {
+      updated->push_back(std::move(results[i]));
+    }
+    previous.erase(it);
+  }
+
+  for (const auto &[key, index] : previous) {
+    removed->push_back(query->last_rows[index][key_column]);
+  }
+
+  query->has_emitted = true;
+  query->last_rows = std::move(rows);
+
+  if (inserted->empty() && updated->empty() && removed->empty()) {
+    return;
+  }
+
+  invoker->invokeAsync([this, inserted, updated, removed, metadata,
+                        callback = query->callback] {
+    auto index = std::make_shared<ColumnIndex>(rt, *metadata);
+    auto res = jsi::Object(rt);
+    res.setProperty(rt, "inserted",
+                    create_row_objects(rt, inserted.get(), index));
+    res.setProperty(rt, "updated",
+                    create_row_objects(rt, updated.get(), index));
+
+    auto removed_keys = jsi::Array(rt, removed->size());
+    for (size_t i = 0; i < removed->size(); i++) {
+      removed_keys.setValueAtIndex(rt, i, to_jsi(rt, removed->at(i)));
+    }
+    res.setProperty(rt, "removed", std::move(removed_keys));
+
+    callback->asObject(rt).asFunction(rt).call(rt, res);
+  });
+}
+
+void DBHostObject::schedule_reactive_query(
+    const std::shared_ptr<ReactiveQuery> &query) {
+  if (query->is_scheduled) {
+    return;
+  }
+
+  query->is_scheduled = true;
+
+  // The database thread has no timers, the JS one does. The timer can fire
+  // after the database is gone, the object is only used once the task checked
+  // the connection is still open, invalidate waits for the queue
+  invoker->invokeAsync([this, self = this, query, queue = _queue,
+                        is_closed = is_closed] {
+    auto rerun = HOST_STATIC_FN("rerun") {
+      if (*is_closed) {
+        return {};
+      }
+
+      queue->queueWork([self, query, is_closed] {
+        if (*is_closed) {
+          return;
+        }
+
+        query->is_scheduled = false;
+        self->run_reactive_query(query);
+      });
+      return {};
+    });
+
+    rt.global()
+        .getPropertyAsFunction(rt, "setTimeout")
+        .call(rt, std::move(rerun), jsi::Value(query->coalesce_ms));
+  });
 }
 
 void DBHostObject::on_commit() {
-  invoker->invokeAsync(
-      [this] { commit_hook_callback->asObject(rt).asFunction(rt).call(rt); });
+  savepoint_marks.clear();
+  send_update_hook_batch();
+  send_change_batch();
+
+  if (commit_hook_callback != nullptr) {
+    invoker->invokeAsync([this, callback = commit_hook_callback] {
+      callback->asObject(rt).asFunction(rt).call(rt);
+    });
+  }
+
+  queue_reactive_flush();
+}
+
+void DBHostObject::queue_reactive_flush() {
+  // The connection cannot be used inside the hook, the queries run right
+  // after the commit. Commits queued before that share the re-run
+  if (is_reactive_flush_queued ||
+      (pending_reactive_queries.empty() && dirty_reactive_tables.empty())) {
+    return;
+  }
+
+  is_reactive_flush_queued = true;
+  _queue->queueWork([this] {
+    is_reactive_flush_queued = false;
+    // A transaction queued before the flush has begun, its uncommitted rows
+    // would be read. The queries stay pending until it commits
+    if (!invalidated && sqlite3_get_autocommit(db) != 0) {
+      flush_pending_reactive_queries(nullptr);
+    }
+  });
 }
 
 void DBHostObject::on_rollback() {
-  invoker->invokeAsync(
-      [this] { rollback_hook_callback->asObject(rt).asFunction(rt).call(rt); });
+  savepoint_marks.clear();
+  // The changes never happened
+  update_hook_batch = UpdateHookBatch();
+  if (change_capture != nullptr) {
+    change_capture->discard();
+  }
+
+  // Queries left pending by a flush that ran inside the transaction
+  queue_reactive_flush();
+
+  if (rollback_hook_callback != nullptr) {
+    invoker->invokeAsync([this, callback = rollback_hook_callback] {
+      callback->asObject(rt).asFunction(rt).call(rt);
+    });
+  }
 }
 
-void DBHostObject::on_update(const std::string &table,
-                             const std::string &operation, long long row_id) {
-  if (update_hook_callback != nullptr) {
-    invoker->invokeAsync(
-        [this, callback = update_hook_callback, table, operation, row_id] {
-          auto res = jsi::Object(rt);
-          res.setProperty(rt, "table", jsi::String::createFromUtf8(rt, table));
-          res.setProperty(rt, "operation",
-                          jsi::String::createFromUtf8(rt, operation));
-          res.setProperty(rt, "rowId", jsi::Value(static_cast<double>(row_id)));
+void DBHostObject::on_update_columns(uint64_t columns) {
+  changed_columns = columns;
+}
 
-          callback->asObject(rt).asFunction(rt).call(rt, res);
-        });
+void DBHostObject::on_change(sqlite3 *connection, int operation,
+                             char const *table, sqlite3_int64 old_row_id,
+                             sqlite3_int64 new_row_id) {
+  if (change_capture != nullptr) {
+    change_capture->capture(connection, operation, table, old_row_id,
+                            new_row_id);
   }
+}
 
-  for (const auto &query_ptr : reactive_queries) {
-    auto query = query_ptr.get();
-    if (query->discriminators.empty()) {
-      continue;
+void DBHostObject::on_savepoint(SavepointOperation operation,
+                                std::string const &name) {
+  if (operation == SAVEPOINT_OPERATION_BEGIN) {
+    savepoint_marks.push_back(SavepointMark{
+        .name = name,
+        .change_position =
+            change_capture != nullptr ? change_capture->position() : 0,
+        .update_position = update_hook_batch.row_ids.size()});
+    return;
+  }
+
+  // Names are case insensitive, the most recent savepoint is the one used
+  auto mark = std::find_if(
+      savepoint_marks.rbegin(), savepoint_marks.rend(), [&](auto &mark) {
+        return strcasecmp(mark.name.c_str(), name.c_str()) == 0;
+      });
+  if (mark == savepoint_marks.rend()) {
+    return;
+  }
+
+  // RELEASE drops the savepoint, ROLLBACK TO keeps it open
+  auto first_closed = operation == SAVEPOINT_OPERATION_RELEASE
+                          ? std::prev(mark.base())
+                          : mark.base();
+
+  if (operation == SAVEPOINT_OPERATION_ROLLBACK_TO) {
+    if (change_capture != nullptr) {
+      change_capture->truncate(mark->change_position);
     }
 
-    bool shouldFire = false;
+    size_t position = mark->update_position;
+    if (position < update_hook_batch.row_ids.size()) {
+      update_hook_batch.table_ids.resize(position);
+      update_hook_batch.operations.resize(position);
+      update_hook_batch.row_ids.resize(position);
+    }
+  }
 
-    for (const auto &discriminator : query->discriminators) {
-      // Tables don't match then skip
-      if (discriminator.table != table) {
-        continue;
+  savepoint_marks.erase(first_closed, savepoint_marks.end());
+}
+
+void DBHostObject::on_transaction_state(bool is_open) {
+  is_writer_in_transaction = is_open;
+}
+
+void DBHostObject::send_change_batch() {
+  if (change_capture == nullptr || change_capture->empty()) {
+    return;
+  }
+
+  auto batch = std::make_shared<ChangeBatch>(change_capture->take());
+
+  // Column names come from a pragma, which cannot run inside the commit hook
+  _queue->queueWork([this, capture = change_capture, batch] {
+    if (invalidated) {
+      return;
+    }
+
+    capture->resolve_columns(db, *batch);
+
+    invoker->invokeAsync([this, callback = change_hook_callback, batch] {
+      if (callback == nullptr) {
+        return;
       }
 
-      // If no ids are specified, then we should fire
-      if (discriminator.ids.empty()) {
-        shouldFire = true;
-        break;
+      auto changes = jsi::Array(rt, batch->changes.size());
+      for (size_t i = 0; i < batch->changes.size(); i++) {
+        const auto &change = batch->changes[i];
+        const auto &columns = batch->columns[change.table_id];
+
+        auto to_js_values = [&](const std::vector<JSVariant> &values) {
+          auto res = jsi::Object(rt);
+          for (size_t j = 0; j < values.size() && j < columns.size(); j++) {
+            res.setProperty(rt, columns[j].c_str(), to_jsi(rt, values[j]));
+          }
+          return res;
+        };
+
+        auto js_change = jsi::Object(rt);
+        js_change.setProperty(
+            rt, "table",
+            jsi::String::createFromUtf8(rt, batch->tables[change.table_id]));
+        js_change.setProperty(
+            rt, "operation",
+            jsi::String::createFromAscii(
+                rt, change.operation == SQLITE_INSERT   ? "INSERT"
+                    : change.operation == SQLITE_DELETE ? "DELETE"
+                                                        : "UPDATE"));
+        js_change.setProperty(rt, "rowId", jsi::Value(change.row_id));
+        if (change.operation != SQLITE_INSERT) {
+          js_change.setProperty(rt, "oldValues",
+                                to_js_values(change.old_values));
+        }
+        if (change.operation != SQLITE_DELETE) {
+          js_change.setProperty(rt, "newValues",
+                                to_js_values(change.new_values));
+        }
+        changes.setValueAtIndex(rt, i, std::move(js_change));
       }
 
-      // If ids are specified, then we should check if the rowId matches
-      for (const auto &discrimator_id : discriminator.ids) {
-        if (row_id == discrimator_id) {
-          shouldFire = true;
+      auto res = jsi::Object(rt);
+      res.setProperty(rt, "changes", std::move(changes));
+      res.setProperty(rt, "dropped",
+                      jsi::Value(static_cast<double>(batch->dropped)));
+      callback->asObject(rt).asFunction(rt).call(rt, res);
+    });
+  });
+}
+
+#ifdef SQLITE_ENABLE_SESSION
+/// Maps 'omit', 'replace' or 'abort' to the action for a conflict type.
+/// Rows can only be replaced on data and conflict conflicts, 'replace' omits
+/// the other changes but still aborts on foreign key violations
+static int to_changeset_action(std::string const &action, int conflict_type) {
+  bool is_replaceable = conflict_type == SQLITE_CHANGESET_DATA ||
+                        conflict_type == SQLITE_CHANGESET_CONFLICT;
+
+  if (action == "omit") {
+    return SQLITE_CHANGESET_OMIT;
+  }
+  if (action == "replace" && is_replaceable) {
+    return SQLITE_CHANGESET_REPLACE;
+  }
+  if (action == "replace" && conflict_type != SQLITE_CHANGESET_FOREIGN_KEY) {
+    return SQLITE_CHANGESET_OMIT;
+  }
+  return SQLITE_CHANGESET_ABORT;
+}
+
+/// Identifies a conflict across the attempts at applying a changeset, from
+/// the change that conflicts and not from the row it conflicts with
+static std::string to_conflict_key(const ChangesetConflict &conflict) {
+  std::string key(1, static_cast<char>(conflict.type));
+  key += static_cast<char>(conflict.operation);
+  key += conflict.table;
+  key += '\0';
+
+  for (const auto *values : {&conflict.old_values, &conflict.new_values}) {
+    key += std::to_string(values->size()) + ":";
+    for (const auto &value : *values) {
+      auto value_key = to_key(value);
+      key += std::to_string(value_key.size()) + ":" + value_key;
+    }
+  }
+
+  return key;
+}
+
+static jsi::Object to_js_conflict(jsi::Runtime &rt,
+                                  const ChangesetConflict &conflict) {
+  const char *types[] = {"",           "data",      "notfound",
+                         "conflict",   "constraint", "foreignKey"};
+  auto to_js_values = [&](const std::vector<JSVariant> &values) {
+    auto res = jsi::Array(rt, values.size());
+    for (size_t i = 0; i < values.size(); i++) {
+      res.setValueAtIndex(rt, i, to_jsi(rt, values[i]));
+    }
+    return res;
+  };
+
+  auto js_conflict = jsi::Object(rt);
+  js_conflict.setProperty(
+      rt, "type", jsi::String::createFromAscii(rt, types[conflict.type]));
+  if (conflict.type != SQLITE_CHANGESET_FOREIGN_KEY) {
+    js_conflict.setProperty(rt, "table",
+                            jsi::String::createFromUtf8(rt, conflict.table));
+    js_conflict.setProperty(
+        rt, "operation",
+        jsi::String::createFromAscii(
+            rt, conflict.operation == SQLITE_INSERT   ? "INSERT"
+                : conflict.operation == SQLITE_DELETE ? "DELETE"
+                                                      : "UPDATE"));
+  }
+  if (!conflict.old_values.empty()) {
+    js_conflict.setProperty(rt, "oldValues",
+                            to_js_values(conflict.old_values));
+  }
+  if (!conflict.new_values.empty()) {
+    js_conflict.setProperty(rt, "newValues",
+                            to_js_values(conflict.new_values));
+  }
+  if (!conflict.conflicting_values.empty()) {
+    js_conflict.setProperty(rt, "conflictingValues",
+                            to_js_values(conflict.conflicting_values));
+  }
+
+  return js_conflict;
+}
+
+/// A changeset applied with an onConflict callback
+struct ChangesetApplication {
+  ArrayBuffer changeset;
+  std::shared_ptr<jsi::Value> on_conflict;
+  std::shared_ptr<jsi::Value> resolve;
+  std::shared_ptr<jsi::Value> reject;
+  /// SQLITE_CHANGESET_ action picked by JS for each conflict key
+  std::unordered_map<std::string, int> decisions;
+};
+
+void DBHostObject::apply_changeset_round(
+    const std::shared_ptr<ChangesetApplication> &application) {
+  if (invalidated) {
+    return;
+  }
+
+  // Outside of a transaction the attempt gets its own, rolling it back also
+  // drops the changes the hooks saw
+  bool is_autocommit = sqlite3_get_autocommit(db) != 0;
+  std::vector<std::pair<std::string, ChangesetConflict>> conflicts;
+  std::string error;
+
+  try {
+    opsqlite_execute(db,
+                     is_autocommit ? "BEGIN IMMEDIATE"
+                                    : "SAVEPOINT op_sqlite_changeset",
+                     nullptr);
+
+    try {
+      opsqlite_apply_changeset(
+          db, application->changeset,
+          [&](int conflict_type, sqlite3_changeset_iter *iterator) {
+            auto conflict = opsqlite_read_conflict(conflict_type, iterator);
+            auto key = to_conflict_key(conflict);
+
+            auto it = application->decisions.find(key);
+            if (it != application->decisions.end()) {
+              return it->second;
+            }
+
+            // Goes on to find the other conflicts, the attempt is undone
+            conflicts.emplace_back(std::move(key), std::move(conflict));
+            return SQLITE_CHANGESET_OMIT;
+          });
+    } catch (std::exception &exc) {
+      error = exc.what();
+    }
+
+    if (error.empty() && conflicts.empty()) {
+      opsqlite_execute(
+          db, is_autocommit ? "COMMIT" : "RELEASE op_sqlite_changeset",
+          nullptr);
+    } else {
+      opsqlite_execute(db,
+                       is_autocommit ? "ROLLBACK"
+                                      : "ROLLBACK TO op_sqlite_changeset; "
+                                        "RELEASE op_sqlite_changeset",
+                       nullptr);
+    }
+  } catch (std::exception &exc) {
+    error = exc.what();
+  }
+
+  if (!error.empty()) {
+    invoker->invokeAsync([this, application, error] {
+      auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
+      auto js_error =
+          errorCtr.callAsConstructor(rt, jsi::String::createFromUtf8(rt, error));
+      application->reject->asObject(rt).asFunction(rt).call(rt, js_error);
+    });
+    return;
+  }
+
+  if (conflicts.empty()) {
+    invoker->invokeAsync([this, application] {
+      application->resolve->asObject(rt).asFunction(rt).call(rt, {});
+    });
+    return;
+  }
+
+  // The database is free while JS decides, the callback can query it
+  invoker->invokeAsync([this, application,
+                        conflicts = std::move(conflicts)] {
+    std::string error;
+
+    try {
+      for (const auto &[key, conflict] : conflicts) {
+        auto res = application->on_conflict->asObject(rt).asFunction(rt).call(
+            rt, to_js_conflict(rt, conflict));
+
+        int action = res.isString()
+                         ? to_changeset_action(res.asString(rt).utf8(rt),
+                                               conflict.type)
+                         : SQLITE_CHANGESET_ABORT;
+        if (action == SQLITE_CHANGESET_ABORT) {
+          error = "[op-sqlite] changeset aborted on conflict";
           break;
         }
+
+        application->decisions[key] = action;
       }
+    } catch (std::exception &exc) {
+      error = exc.what();
     }
 
-    if (shouldFire) {
-      pending_reactive_queries.insert(query_ptr);
+    if (!error.empty()) {
+      auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
+      auto js_error =
+          errorCtr.callAsConstructor(rt, jsi::String::createFromUtf8(rt, error));
+      application->reject->asObject(rt).asFunction(rt).call(rt, js_error);
+      return;
     }
+
+    _queue->queueWork(
+        [this, application] { apply_changeset_round(application); });
+  });
+}
+#endif
+
+size_t DBHostObject::intern_table(char const *table) {
+  if (last_table == table) {
+    return last_table_id;
   }
+
+  auto [it, inserted] = table_ids.try_emplace(table, table_names.size());
+  if (inserted) {
+    table_names.emplace_back(table);
+    reactive_tables.push_back(ReactiveTable{.id = it->second});
+  }
+
+  last_table = table;
+  last_table_id = it->second;
+  return last_table_id;
 }
 
-void DBHostObject::auto_register_update_hook() {
-  if (update_hook_callback == nullptr && reactive_queries.empty() &&
-      is_update_hook_registered) {
-    opsqlite_deregister_update_hook(db);
-    is_update_hook_registered = false;
+void DBHostObject::on_update(char const *table, UpdateOperation operation,
+                             long long row_id) {
+  bool is_update = operation == UPDATE_OPERATION_UPDATE;
+  uint64_t columns = is_update ? changed_columns : ALL_COLUMNS;
+  changed_columns = ALL_COLUMNS;
+
+  size_t table_id = intern_table(table);
+
+  if (update_hook_callback != nullptr) {
+    update_hook_batch.table_ids.push_back(static_cast<uint32_t>(table_id));
+    update_hook_batch.operations.push_back(operation);
+    update_hook_batch.row_ids.push_back(row_id);
+  }
+
+  auto &reactive_table = reactive_tables[table_id];
+  if (reactive_table.table_subscriptions.empty() &&
+      reactive_table.row_subscriptions.empty()) {
+    return;
+  }
+
+  // Nothing the queries could read changed, e.g. an UPDATE setting the same
+  // values
+  if (is_update && columns == 0) {
     return;
   }
 
-  if (is_update_hook_registered) {
+  if (reactive_table.changed_columns == 0 && !reactive_table.rows_changed) {
+    dirty_reactive_tables.push_back(table_id);
+  }
+  reactive_table.changed_columns |= columns;
+  reactive_table.rows_changed = reactive_table.rows_changed || !is_update;
+
+  auto it = reactive_table.row_subscriptions.find(row_id);
+  if (it == reactive_table.row_subscriptions.end()) {
     return;
   }
 
-  opsqlite_register_update_hook(db, this);
-  is_update_hook_registered = true;
+  for (const auto &subscription : it->second) {
+    if (!is_update || (subscription.columns & columns) != 0) {
+      queue_reactive_query(subscription.query);
+    }
+  }
+}
+
+void DBHostObject::send_update_hook_batch() {
+  if (update_hook_batch.row_ids.empty()) {
+    return;
+  }
+
+  auto batch = std::make_shared<UpdateHookBatch>(std::move(update_hook_batch));
+  update_hook_batch = UpdateHookBatch();
+
+  // Names of the tables seen so far, ids index into it
+  auto tables = std::make_shared<std::vector<std::string>>(table_names);
+
+  invoker->invokeAsync([this, callback = update_hook_callback, batch, tables] {
+    if (callback == nullptr) {
+      return;
+    }
+
+    auto array_buffer_ctor =
+        rt.global().getPropertyAsFunction(rt, "ArrayBuffer");
+    auto res = jsi::Object(rt);
+
+    auto js_tables = jsi::Array(rt, tables->size());
+    for (size_t i = 0; i < tables->size(); i++) {
+      js_tables.setValueAtIndex(
+          rt, i, jsi::String::createFromUtf8(rt, tables->at(i)));
+    }
+    res.setProperty(rt, "tables", std::move(js_tables));
+    res.setProperty(rt, "tableIds",
+                    create_array_buffer(rt, array_buffer_ctor,
+                                        batch->table_ids.data(),
+                                        batch->table_ids.size() *
+                                            sizeof(uint32_t)));
+    res.setProperty(rt, "operations",
+                    create_array_buffer(rt, array_buffer_ctor,
+                                        batch->operations.data(),
+                                        batch->operations.size()));
+    res.setProperty(rt, "rowIds",
+                    create_array_buffer(rt, array_buffer_ctor,
+                                        batch->row_ids.data(),
+                                        batch->row_ids.size() *
+                                            sizeof(int64_t)));
+
+    callback->asObject(rt).asFunction(rt).call(rt, res);
+  });
+}
+
+void DBHostObject::queue_reactive_query(
+    const std::shared_ptr<ReactiveQuery> &query) {
+  if (query->is_pending) {
+    return;
+  }
+
+  query->is_pending = true;
+  pending_reactive_queries.push_back(query);
+}
+
+void DBHostObject::index_reactive_queries(
+    const std::vector<std::shared_ptr<ReactiveQuery>> &queries) {
+  for (auto &reactive_table : reactive_tables) {
+    reactive_table.table_subscriptions.clear();
+    reactive_table.row_subscriptions.clear();
+  }
+
+  for (const auto &query : queries) {
+    for (const auto &discriminator : query->discriminators) {
+      auto &reactive_table =
+          reactive_tables[intern_table(discriminator.table.c_str())];
+      ReactiveSubscription subscription{query, discriminator.columns};
+
+      if (discriminator.ids.empty()) {
+        reactive_table.table_subscriptions.push_back(subscription);
+        continue;
+      }
+
+      for (int id : discriminator.ids) {
+        reactive_table.row_subscriptions[id].push_back(subscription);
+      }
+    }
+  }
+}
+
+void DBHostObject::auto_register_update_hook() {
+  bool is_needed = update_hook_callback != nullptr ||
+                   !reactive_queries.empty() || change_hook_callback != nullptr;
+
+  if (is_needed != is_update_hook_registered) {
+    if (is_needed) {
+      opsqlite_register_update_hook(db, this);
+    } else {
+      opsqlite_deregister_update_hook(db);
+    }
+    is_update_hook_registered = is_needed;
+  }
+
+  // The preupdate hook belongs to the sessions while one is open, reactive
+  // queries then treat every column of an UPDATE as changed
+  bool is_preupdate_needed = is_needed && !has_open_sessions();
+  if (is_preupdate_needed != is_preupdate_hook_registered) {
+    if (is_preupdate_needed) {
+      opsqlite_register_preupdate_hook(db, this);
+    } else {
+      opsqlite_deregister_preupdate_hook(db);
+    }
+    is_preupdate_hook_registered = is_preupdate_needed;
+  }
+
+  // Events undone by a ROLLBACK TO are not sent
+  bool is_following_needed =
+      update_hook_callback != nullptr || change_hook_callback != nullptr;
+  if (is_following_needed != is_following_savepoints) {
+    opsqlite_set_statement_trace(db, this, is_following_needed,
+                                 !readers.empty());
+    is_following_savepoints = is_following_needed;
+  }
+}
+
+bool DBHostObject::has_open_sessions() {
+#ifdef SQLITE_ENABLE_SESSION
+  std::erase_if(sessions, [](auto &session) {
+    auto alive = session.lock();
+    return alive == nullptr || !alive->is_open();
+  });
+  return !sessions.empty();
+#else
+  return false;
+#endif
+}
+
+void DBHostObject::auto_register_commit_hook() {
+  // Update hook events are sent on commit and dropped on rollback
+  if (commit_hook_callback == nullptr && update_hook_callback == nullptr &&
+      change_hook_callback == nullptr && reactive_queries.empty()) {
+    opsqlite_deregister_commit_hook(db);
+  } else {
+    opsqlite_register_commit_hook(db, this);
+  }
+
+  // A rollback also re-queues the reactive flush a transaction held back
+  if (rollback_hook_callback == nullptr && update_hook_callback == nullptr &&
+      change_hook_callback == nullptr && reactive_queries.empty()) {
+    opsqlite_deregister_rollback_hook(db);
+  } else {
+    opsqlite_register_rollback_hook(db, this);
+  }
 }
 #endif
 
@@ -135,22 +863,24 @@ void DBHostObject::auto_register_update_hook() {
 #ifdef OP_SQLITE_USE_LIBSQL
 DBHostObject::DBHostObject(jsi::Runtime &rt, std::string &url,
                            std::string &auth_token,
-                           std::shared_ptr<react::CallInvoker> invoker
+                           std::shared_ptr<JSCallInvoker> invoker
                            )
     : db_name(url), invoker(std::move(invoker)),
       rt(rt) {
+  _queue = ThreadPool::shared()->createQueue();
   db = opsqlite_libsql_open_remote(url, auth_token);
 
   create_jsi_functions();
 }
 
 DBHostObject::DBHostObject(jsi::Runtime &rt,
-                           std::shared_ptr<react::CallInvoker> invoker,
+                           std::shared_ptr<JSCallInvoker> invoker,
                            std::string &db_name, std::string &path,
                            std::string &url, std::string &auth_token,
                            int sync_interval)
     : db_name(db_name), invoker(std::move(invoker)),
       rt(rt) {
+  _queue = ThreadPool::shared()->createQueue();
   db =
       opsqlite_libsql_open_sync(db_name, path, url, auth_token, sync_interval);
 
@@ -161,25 +891,142 @@ DBHostObject::DBHostObject(jsi::Runtime &rt,
 #endif
 
 DBHostObject::DBHostObject(jsi::Runtime &rt, std::string &base_path,
-                           std::shared_ptr<react::CallInvoker> invoker,
+                           std::shared_ptr<JSCallInvoker> invoker,
                            std::string &db_name, std::string &path,
                            std::string &crsqlite_path,
                            std::string &sqlite_vec_path,
-                           std::string &encryption_key)
+                           std::string &encryption_key,
+                           size_t statement_cache_size, size_t reader_count)
     : base_path(base_path), invoker(std::move(invoker)), db_name(db_name),
       rt(rt) {
-  _thread_pool = std::make_shared<ThreadPool>();
+  _queue = ThreadPool::shared()->createQueue();
+
+#ifdef OP_SQLITE_USE_SQLCIPHER
+  db = opsqlite_open(db_name, path, crsqlite_path,
+                                      sqlite_vec_path, encryption_key);
+#elif OP_SQLITE_USE_LIBSQL
+  db = opsqlite_libsql_open(db_name, path, crsqlite_path);
+#else
+  db = opsqlite_open(db_name, path, crsqlite_path, sqlite_vec_path);
+#endif
+
+#ifndef OP_SQLITE_USE_LIBSQL
+  opsqlite_set_statement_cache_size(db, statement_cache_size);
+
+  // In memory databases cannot be shared between connections
+  if (reader_count > 0 && path != ":memory:") {
+    // Readers only see a consistent snapshot next to the writer in WAL mode
+    opsqlite_execute(db, "PRAGMA journal_mode = WAL", nullptr);
+
+    for (size_t i = 0; i < reader_count; i++) {
+#ifdef OP_SQLITE_USE_SQLCIPHER
+      sqlite3 *reader_db = opsqlite_open(db_name, path, crsqlite_path,
+                                         sqlite_vec_path, encryption_key, true);
+#else
+      sqlite3 *reader_db =
+          opsqlite_open(db_name, path, crsqlite_path, sqlite_vec_path, true);
+#endif
+      opsqlite_set_statement_cache_size(reader_db, statement_cache_size);
+      readers.push_back(
+          {.db = reader_db, .queue = ThreadPool::shared()->createQueue()});
+    }
+
+    // Whatever runs BEGIN, the reads follow the writer into its transaction
+    opsqlite_set_statement_trace(db, this, false, true);
+  }
+#endif
+  create_jsi_functions();
+};
+
+#ifndef OP_SQLITE_USE_LIBSQL
+// Reader connection of the task running on the current thread, if any
+static thread_local sqlite3 *current_reader = nullptr;
+
+sqlite3 *DBHostObject::connection() {
+  return current_reader != nullptr ? current_reader : db;
+}
+
+static bool starts_with_keyword(std::string const &query, const char *keyword) {
+  size_t start = 0;
+  while (start < query.size() &&
+         (isspace(static_cast<unsigned char>(query[start])) ||
+          query[start] == '(')) {
+    start++;
+  }
+
+  size_t length = strlen(keyword);
+  if (query.size() - start < length ||
+      strncasecmp(query.c_str() + start, keyword, length) != 0) {
+    return false;
+  }
+
+  return start + length == query.size() ||
+         !isalnum(static_cast<unsigned char>(query[start + length]));
+}
+
+/// Only statements starting with these keywords are considered for the
+/// readers, transaction statements like BEGIN also pass sqlite3_stmt_readonly
+static bool is_read_candidate(std::string const &query) {
+  for (const char *keyword : {"SELECT", "WITH", "VALUES"}) {
+    if (starts_with_keyword(query, keyword)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void DBHostObject::queue_read(std::string const &query, Task task,
+                              Priority priority) {
+  if (readers.empty() || !is_read_candidate(query)) {
+    _queue->queueWork(std::move(task), priority);
+    return;
+  }
+
+  auto &reader = readers[next_reader++ % readers.size()];
+  // A Task does not fit inside another one, held by pointer the wrapper
+  // stays inline
+  auto read = std::make_unique<Task>(std::move(task));
+
+  reader.queue->queueWork(
+      [this, reader_db = reader.db, query, read = std::move(read),
+       priority]() mutable {
+        // Queries inside a transaction need to see its uncommitted writes,
+        // the state is the one of the writer when the read is about to run
+        if (is_writer_in_transaction ||
+            !opsqlite_is_readonly(reader_db, query)) {
+          _queue->queueWork(std::move(*read), priority);
+          return;
+        }
+
+        current_reader = reader_db;
+        (*read)();
+        current_reader = nullptr;
+      },
+      priority);
+}
+
+void DBHostObject::close_sessions() {
+#ifdef SQLITE_ENABLE_SESSION
+  // A session cannot outlive its connection
+  for (auto &session : sessions) {
+    if (auto alive = session.lock()) {
+      alive->close();
+    }
+  }
+  sessions.clear();
+#endif
+}
 
-#ifdef OP_SQLITE_USE_SQLCIPHER
-  db = opsqlite_open(db_name, path, crsqlite_path,
-                                      sqlite_vec_path, encryption_key);
-#elif OP_SQLITE_USE_LIBSQL
-  db = opsqlite_libsql_open(db_name, path, crsqlite_path);
-#else
-  db = opsqlite_open(db_name, path, crsqlite_path, sqlite_vec_path);
+void DBHostObject::close_readers() {
+  for (auto &reader : readers) {
+    // The connection cannot be closed while a read is using it
+    reader.queue->waitFinished();
+    opsqlite_close(reader.db);
+  }
+  readers.clear();
+}
 #endif
-  create_jsi_functions();
-};
 
 void DBHostObject::create_jsi_functions() {
   function_map["attach"] = HOSTFN("attach") {
@@ -241,6 +1088,11 @@ void DBHostObject::create_jsi_functions() {
 #ifdef OP_SQLITE_USE_LIBSQL
     opsqlite_libsql_close(db);
 #else
+    *is_closed = true;
+    close_readers();
+    // Sessions are used by the queued tasks
+    _queue->waitFinished();
+    close_sessions();
     opsqlite_close(db);
 #endif
 
@@ -272,6 +1124,11 @@ void DBHostObject::create_jsi_functions() {
 #ifdef OP_SQLITE_USE_LIBSQL
     opsqlite_libsql_remove(db, db_name, path);
 #else
+    *is_closed = true;
+    close_readers();
+    // Sessions are used by the queued tasks
+    _queue->waitFinished();
+    close_sessions();
     opsqlite_remove(db, db_name, path);
 #endif
 
@@ -280,24 +1137,32 @@ void DBHostObject::create_jsi_functions() {
 
   function_map["executeRaw"] = HOSTFN("executeRaw") {
     const std::string query = args[0].asString(rt).utf8(rt);
-    std::vector<JSVariant> params = count == 2 && args[1].isObject()
+    std::vector<JSVariant> params = count >= 2 && args[1].isObject()
                                         ? to_variant_vec(rt, args[1])
                                         : std::vector<JSVariant>();
+    Priority priority =
+        count >= 3 ? to_priority(rt, args[2]) : PRIORITY_NORMAL;
+    auto cancellation = std::make_shared<QueryCancellation>(
+        count >= 3 ? to_timeout(rt, args[2]) : 0);
 
-    auto promiseCtr = rt.global().getPropertyAsFunction(rt, "Promise");
+    auto &promiseCtr = invoker->get_promise_constructor();
     auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
       auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
       auto reject = std::make_shared<jsi::Value>(rt, args[1]);
 
-      auto task = [this, &rt, query, params, resolve, reject]() {
+      auto task = [this, &rt, query, params, resolve, reject,
+                   cancellation]() {
         try {
           std::vector<std::vector<JSVariant>> results;
 
 #ifdef OP_SQLITE_USE_LIBSQL
+          CancellationScope scope(cancellation);
           auto status =
               opsqlite_libsql_execute_raw(db, query, &params, &results);
 #else
-          auto status = opsqlite_execute_raw(db, query, &params, &results);
+          CancellationScope scope(cancellation, connection());
+          auto status =
+              opsqlite_execute_raw(connection(), query, &params, &results);
 #endif
 
           if (invalidated) {
@@ -311,7 +1176,7 @@ void DBHostObject::create_jsi_functions() {
           });
         } catch (std::runtime_error &e) {
           auto what = e.what();
-          invoker->invokeAsync([&rt, what, reject] {
+          invoker->invokeAsync([&rt, what = std::string(what), reject] {
             auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
             auto error = errorCtr.callAsConstructor(
                 rt, jsi::String::createFromAscii(rt, what));
@@ -319,7 +1184,7 @@ void DBHostObject::create_jsi_functions() {
           });
         } catch (std::exception &exc) {
           auto what = exc.what();
-          invoker->invokeAsync([&rt, what, reject] {
+          invoker->invokeAsync([&rt, what = std::string(what), reject] {
             auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
             auto error = errorCtr.callAsConstructor(
                 rt, jsi::String::createFromAscii(rt, what));
@@ -328,11 +1193,17 @@ void DBHostObject::create_jsi_functions() {
         }
       };
 
-      _thread_pool->queueWork(task);
+#ifdef OP_SQLITE_USE_LIBSQL
+      _queue->queueWork(task, priority);
+#else
+      queue_read(query, task, priority);
+#endif
 
       return {};
      }));
 
+    set_cancel_function(rt, promise, cancellation);
+
     return promise;
   });
 
@@ -354,21 +1225,32 @@ void DBHostObject::create_jsi_functions() {
 
   function_map["execute"] = HOSTFN("execute") {
     const std::string query = args[0].asString(rt).utf8(rt);
-    std::vector<JSVariant> params = count == 2 && args[1].isObject()
+    std::vector<JSVariant> params = count >= 2 && args[1].isObject()
                                         ? to_variant_vec(rt, args[1])
                                         : std::vector<JSVariant>();
-
-    auto promiseCtr = rt.global().getPropertyAsFunction(rt, "Promise");
+    Priority priority =
+        count >= 3 ? to_priority(rt, args[2]) : PRIORITY_NORMAL;
+    auto cancellation = std::make_shared<QueryCancellation>(
+        count >= 3 ? to_timeout(rt, args[2]) : 0);
+    auto js_raw_rows = count >= 3 && args[2].isObject()
+                           ? args[2].asObject(rt).getProperty(rt, "rawRows")
+                           : jsi::Value();
+    bool with_raw_rows = js_raw_rows.isBool() && js_raw_rows.getBool();
+
+    auto &promiseCtr = invoker->get_promise_constructor();
     auto promise = promiseCtr.callAsConstructor(rt,
  HOSTFN("executor") {
       auto task = [this, &rt, query, params,
                    resolve = std::make_shared<jsi::Value>(rt, args[0]),
-                   reject = std::make_shared<jsi::Value>(rt, args[1])]() {
+                   reject = std::make_shared<jsi::Value>(rt, args[1]),
+                   cancellation, with_raw_rows]() {
         try {
 #ifdef OP_SQLITE_USE_LIBSQL
+          CancellationScope scope(cancellation);
           auto status = opsqlite_libsql_execute(db, query, &params);
 #else
-          auto status = opsqlite_execute(db, query, &params);
+          CancellationScope scope(cancellation, connection());
+          auto status = opsqlite_execute(connection(), query, &params);
 #endif
 
           if (invalidated) {
@@ -376,8 +1258,8 @@ void DBHostObject::create_jsi_functions() {
           }
 
           invoker->invokeAsync([&rt, status = std::move(status), resolve,
-                                reject] {
-            auto jsiResult = create_js_rows(rt, status);
+                                reject, with_raw_rows] {
+            auto jsiResult = create_js_rows(rt, status, with_raw_rows);
             resolve->asObject(rt).asFunction(rt).call(rt, std::move(jsiResult));
           });
           // On Android RN is broken and does not correctly match runtime_error
@@ -402,11 +1284,87 @@ void DBHostObject::create_jsi_functions() {
         }
       };
 
-      _thread_pool->queueWork(task);
+#ifdef OP_SQLITE_USE_LIBSQL
+      _queue->queueWork(task, priority);
+#else
+      queue_read(query, task, priority);
+#endif
+
+      return {};
+    }));
+
+    set_cancel_function(rt, promise, cancellation);
+
+    return promise;
+  });
+
+  function_map["executeResultSet"] = HOSTFN("executeResultSet") {
+    const std::string query = args[0].asString(rt).utf8(rt);
+    std::vector<JSVariant> params = count >= 2 && args[1].isObject()
+                                        ? to_variant_vec(rt, args[1])
+                                        : std::vector<JSVariant>();
+    Priority priority =
+        count >= 3 ? to_priority(rt, args[2]) : PRIORITY_NORMAL;
+    auto cancellation = std::make_shared<QueryCancellation>(
+        count >= 3 ? to_timeout(rt, args[2]) : 0);
+
+    auto &promiseCtr = invoker->get_promise_constructor();
+    auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
+      auto task = [this, &rt, query, params,
+                   resolve = std::make_shared<jsi::Value>(rt, args[0]),
+                   reject = std::make_shared<jsi::Value>(rt, args[1]),
+                   cancellation]() {
+        try {
+#ifdef OP_SQLITE_USE_LIBSQL
+          CancellationScope scope(cancellation);
+          auto status = opsqlite_libsql_execute(db, query, &params);
+#else
+          CancellationScope scope(cancellation, connection());
+          auto status = opsqlite_execute(connection(), query, &params);
+#endif
+
+          if (invalidated) {
+            return;
+          }
+
+          // The rows are moved into the host object once and never copied
+          auto result_set =
+              std::make_shared<ResultSetHostObject>(std::move(status));
+
+          invoker->invokeAsync([&rt, result_set, resolve] {
+            auto jsiResult = jsi::Object::createFromHostObject(rt, result_set);
+            resolve->asObject(rt).asFunction(rt).call(rt, std::move(jsiResult));
+          });
+        } catch (std::runtime_error &e) {
+          auto what = e.what();
+          invoker->invokeAsync([&rt, what = std::string(what), reject] {
+            auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
+            auto error = errorCtr.callAsConstructor(
+                rt, jsi::String::createFromAscii(rt, what));
+            reject->asObject(rt).asFunction(rt).call(rt, error);
+          });
+        } catch (std::exception &exc) {
+          auto what = exc.what();
+          invoker->invokeAsync([&rt, what = std::string(what), reject] {
+            auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
+            auto error = errorCtr.callAsConstructor(
+                rt, jsi::String::createFromAscii(rt, what));
+            reject->asObject(rt).asFunction(rt).call(rt, error);
+          });
+        }
+      };
+
+#ifdef OP_SQLITE_USE_LIBSQL
+      _queue->queueWork(task, priority);
+#else
+      queue_read(query, task, priority);
+#endif
 
       return {};
     }));
 
+    set_cancel_function(rt, promise, cancellation);
+
     return promise;
   });
 
@@ -414,27 +1372,34 @@ void DBHostObject::create_jsi_functions() {
     const std::string query = args[0].asString(rt).utf8(rt);
     std::vector<JSVariant> params;
 
-    if (count == 2) {
+    if (count >= 2 && args[1].isObject()) {
       const jsi::Value &originalParams = args[1];
       params = to_variant_vec(rt, originalParams);
     }
+    Priority priority =
+        count >= 3 ? to_priority(rt, args[2]) : PRIORITY_NORMAL;
+    auto cancellation = std::make_shared<QueryCancellation>(
+        count >= 3 ? to_timeout(rt, args[2]) : 0);
 
-    auto promiseCtr = rt.global().getPropertyAsFunction(rt, "Promise");
+    auto &promiseCtr = invoker->get_promise_constructor();
     auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
       auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
       auto reject = std::make_shared<jsi::Value>(rt, args[1]);
 
-      auto task = [&rt, this, query, params, resolve, reject]() {
+      auto task = [&rt, this, query, params, resolve, reject,
+                   cancellation]() {
         try {
           std::vector<DumbHostObject> results;
           std::shared_ptr<std::vector<SmartHostObject>> metadata =
               std::make_shared<std::vector<SmartHostObject>>();
 #ifdef OP_SQLITE_USE_LIBSQL
+          CancellationScope scope(cancellation);
           auto status = opsqlite_libsql_execute_with_host_objects(
               db, query, &params, &results, metadata);
 #else
-          auto status = opsqlite_execute_host_objects(db, query, &params,
-                                                      &results, metadata);
+          CancellationScope scope(cancellation, connection());
+          auto status = opsqlite_execute_host_objects(
+              connection(), query, &params, &results, metadata);
 #endif
 
           if (invalidated) {
@@ -460,7 +1425,7 @@ void DBHostObject::create_jsi_functions() {
           });
         } catch (std::exception &exc) {
           auto what = exc.what();
-          invoker->invokeAsync([&rt, what, reject] {
+          invoker->invokeAsync([&rt, what = std::string(what), reject] {
             auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
             auto error = errorCtr.callAsConstructor(
                 rt, jsi::String::createFromAscii(rt, what));
@@ -469,11 +1434,17 @@ void DBHostObject::create_jsi_functions() {
         }
       };
 
-      _thread_pool->queueWork(task);
+#ifdef OP_SQLITE_USE_LIBSQL
+      _queue->queueWork(task, priority);
+#else
+      queue_read(query, task, priority);
+#endif
 
       return {};
       }));
 
+    set_cancel_function(rt, promise, cancellation);
+
     return promise;
   });
 
@@ -497,8 +1468,12 @@ void DBHostObject::create_jsi_functions() {
 
     std::vector<BatchArguments> commands;
     to_batch_arguments(rt, batchParams, &commands);
+    Priority priority =
+        count >= 2 ? to_priority(rt, args[1]) : PRIORITY_NORMAL;
+    auto cancellation = std::make_shared<QueryCancellation>(
+        count >= 2 ? to_timeout(rt, args[1]) : 0);
 
-    auto promiseCtr = rt.global().getPropertyAsFunction(rt, "Promise");
+    auto &promiseCtr = invoker->get_promise_constructor();
     auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
       auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
       auto reject = std::make_shared<jsi::Value>(rt, args[1]);
@@ -506,12 +1481,15 @@ void DBHostObject::create_jsi_functions() {
       auto task = [this, &rt,
                    commands =
                        std::make_shared<std::vector<BatchArguments>>(commands),
-                   resolve, reject]() {
+                   resolve, reject,
+                   cancellation]() {
         try {
 #ifdef OP_SQLITE_USE_LIBSQL
+          CancellationScope scope(cancellation);
           auto batchResult =
               opsqlite_libsql_execute_batch(db, commands.get());
 #else
+          CancellationScope scope(cancellation, db);
           auto batchResult = opsqlite_execute_batch(db, commands.get());
 #endif
 
@@ -528,7 +1506,7 @@ void DBHostObject::create_jsi_functions() {
               });
         } catch (std::runtime_error &e) {
           auto what = e.what();
-          invoker->invokeAsync([&rt, what, reject] {
+          invoker->invokeAsync([&rt, what = std::string(what), reject] {
             auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
             auto error = errorCtr.callAsConstructor(
                 rt, jsi::String::createFromAscii(rt, what));
@@ -536,7 +1514,7 @@ void DBHostObject::create_jsi_functions() {
           });
         } catch (std::exception &exc) {
           auto what = exc.what();
-          invoker->invokeAsync([&rt, what, reject] {
+          invoker->invokeAsync([&rt, what = std::string(what), reject] {
             auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
             auto error = errorCtr.callAsConstructor(
                 rt, jsi::String::createFromAscii(rt, what));
@@ -544,11 +1522,13 @@ void DBHostObject::create_jsi_functions() {
           });
         }
       };
-      _thread_pool->queueWork(task);
+      _queue->queueWork(task, priority);
 
       return {};
     }));
 
+    set_cancel_function(rt, promise, cancellation);
+
     return promise;
   });
 
@@ -567,7 +1547,7 @@ void DBHostObject::create_jsi_functions() {
 
     const std::string sqlFileName = args[0].asString(rt).utf8(rt);
 
-    auto promiseCtr = rt.global().getPropertyAsFunction(rt, "Promise");
+    auto &promiseCtr = invoker->get_promise_constructor();
     auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
       auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
       auto reject = std::make_shared<jsi::Value>(rt, args[1]);
@@ -601,10 +1581,74 @@ void DBHostObject::create_jsi_functions() {
           });
         }
       };
-      _thread_pool->queueWork(task);
+      _queue->queueWork(task);
+      return {};
+    }));
+
+    return promise;
+  });
+
+  function_map["executeColumnar"] = HOSTFN("executeColumnar") {
+    const std::string query = args[0].asString(rt).utf8(rt);
+    std::vector<JSVariant> params = count >= 2 && args[1].isObject()
+                                        ? to_variant_vec(rt, args[1])
+                                        : std::vector<JSVariant>();
+    Priority priority =
+        count >= 3 ? to_priority(rt, args[2]) : PRIORITY_NORMAL;
+    auto cancellation = std::make_shared<QueryCancellation>(
+        count >= 3 ? to_timeout(rt, args[2]) : 0);
+
+    auto &promiseCtr = invoker->get_promise_constructor();
+    auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
+      auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
+      auto reject = std::make_shared<jsi::Value>(rt, args[1]);
+
+      auto task = [this, &rt, query, params, resolve, reject,
+                   cancellation]() {
+        try {
+          std::vector<ColumnarColumn> columns;
+          size_t row_count;
+
+          CancellationScope scope(cancellation, connection());
+          auto status = opsqlite_execute_columnar(
+              connection(), query, &params, &columns, &row_count);
+
+          if (invalidated) {
+            return;
+          }
+
+          invoker->invokeAsync([&rt, columns = std::move(columns), row_count,
+                                status = std::move(status), resolve] {
+            auto jsiResult =
+                create_columnar_result(rt, status, &columns, row_count);
+            resolve->asObject(rt).asFunction(rt).call(rt, std::move(jsiResult));
+          });
+        } catch (std::runtime_error &e) {
+          auto what = e.what();
+          invoker->invokeAsync([&rt, what = std::string(what), reject] {
+            auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
+            auto error = errorCtr.callAsConstructor(
+                rt, jsi::String::createFromAscii(rt, what));
+            reject->asObject(rt).asFunction(rt).call(rt, error);
+          });
+        } catch (std::exception &exc) {
+          auto what = exc.what();
+          invoker->invokeAsync([&rt, what = std::string(what), reject] {
+            auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
+            auto error = errorCtr.callAsConstructor(
+                rt, jsi::String::createFromAscii(rt, what));
+            reject->asObject(rt).asFunction(rt).call(rt, error);
+          });
+        }
+      };
+
+      queue_read(query, task, priority);
+
       return {};
     }));
 
+    set_cancel_function(rt, promise, cancellation);
+
     return promise;
   });
 
@@ -618,6 +1662,7 @@ void DBHostObject::create_jsi_functions() {
     }
 
     auto_register_update_hook();
+    auto_register_commit_hook();
     return {};
   });
 
@@ -628,12 +1673,13 @@ void DBHostObject::create_jsi_functions() {
 
     auto callback = std::make_shared<jsi::Value>(rt, args[0]);
     if (callback->isUndefined() || callback->isNull()) {
-      opsqlite_deregister_commit_hook(db);
-      return {};
+      commit_hook_callback = nullptr;
+    } else {
+      commit_hook_callback = callback;
     }
-    commit_hook_callback = callback;
-    opsqlite_register_commit_hook(db, this);
 
+    // Reactive queries and the update hook keep it registered
+    auto_register_commit_hook();
     return {};
   });
 
@@ -643,17 +1689,197 @@ void DBHostObject::create_jsi_functions() {
     }
 
     auto callback = std::make_shared<jsi::Value>(rt, args[0]);
-
     if (callback->isUndefined() || callback->isNull()) {
-      opsqlite_deregister_rollback_hook(db);
-      return {};
+      rollback_hook_callback = nullptr;
+    } else {
+      rollback_hook_callback = callback;
     }
-    rollback_hook_callback = callback;
 
-    opsqlite_register_rollback_hook(db, this);
+    auto_register_commit_hook();
+    return {};
+  });
+
+  function_map["changeHook"] = HOSTFN("changeHook") {
+    if (count < 1) {
+      throw std::runtime_error("[op-sqlite][changeHook] callback needed");
+    }
+
+#ifndef SQLITE_ENABLE_PREUPDATE_HOOK
+    throw std::runtime_error("[op-sqlite][changeHook] SQLite was compiled "
+                             "without SQLITE_ENABLE_PREUPDATE_HOOK");
+#endif
+
+    std::shared_ptr<ChangeCapture> capture;
+
+    if (args[0].isUndefined() || args[0].isNull()) {
+      change_hook_callback = nullptr;
+    } else {
+      if (has_open_sessions()) {
+        throw std::runtime_error("[op-sqlite][changeHook] cannot be set while "
+                                 "a session is open");
+      }
+
+      size_t size = DEFAULT_CHANGE_CAPTURE_SIZE;
+      std::vector<ChangeCaptureFilter> filters;
+
+      if (count > 1 && args[1].isObject()) {
+        auto options = args[1].asObject(rt);
+
+        auto js_size = options.getProperty(rt, "bufferSize");
+        if (!js_size.isUndefined()) {
+          size = to_count(rt, js_size, "bufferSize");
+          if (size == 0) {
+            throw std::runtime_error(
+                "[op-sqlite][changeHook] bufferSize must be at least 1");
+          }
+        }
+
+        auto js_tables = options.getProperty(rt, "tables");
+        if (js_tables.isObject()) {
+          auto tables = js_tables.asObject(rt).asArray(rt);
+          for (size_t i = 0; i < tables.length(rt); i++) {
+            auto table = tables.getValueAtIndex(rt, i).asObject(rt);
+            ChangeCaptureFilter filter;
+            filter.table = table.getProperty(rt, "table").asString(rt).utf8(rt);
+            auto columns = table.getProperty(rt, "columns");
+            if (columns.isObject()) {
+              filter.columns = to_string_vec(rt, columns);
+            }
+            filters.push_back(std::move(filter));
+          }
+        }
+      }
+
+      // Throws if a table or a column does not exist
+      capture = std::make_shared<ChangeCapture>(db, size, filters);
+      change_hook_callback = std::make_shared<jsi::Value>(rt, args[0]);
+    }
+
+    // Only the database thread touches the capture
+    _queue->queueWork([this, capture] { change_capture = capture; });
+
+    auto_register_update_hook();
+    auto_register_commit_hook();
     return {};
   });
 
+  function_map["createSession"] = HOSTFN("createSession") {
+#ifndef SQLITE_ENABLE_SESSION
+    throw std::runtime_error("[op-sqlite][createSession] SQLite was compiled "
+                             "without SQLITE_ENABLE_SESSION");
+#else
+    // Both need the preupdate hook of the connection
+    if (change_hook_callback != nullptr) {
+      throw std::runtime_error("[op-sqlite][createSession] cannot create a "
+                               "session while a change hook is set");
+    }
+
+    std::vector<std::string> tables;
+    if (count > 0 && args[0].isObject()) {
+      tables = to_string_vec(rt, args[0]);
+    }
+
+    // The session reads the context of the hook it finds as its own list
+    if (is_preupdate_hook_registered) {
+      opsqlite_deregister_preupdate_hook(db);
+      is_preupdate_hook_registered = false;
+    }
+
+    std::shared_ptr<SessionHostObject> session;
+    try {
+      session = std::make_shared<SessionHostObject>(
+          opsqlite_create_session(db, tables), invoker, _queue);
+    } catch (...) {
+      auto_register_update_hook();
+      throw;
+    }
+
+    std::erase_if(sessions, [](auto &session) { return session.expired(); });
+    sessions.push_back(session);
+
+    return jsi::Object::createFromHostObject(rt, session);
+#endif
+  });
+
+  function_map["applyChangeset"] = HOSTFN("applyChangeset") {
+#ifndef SQLITE_ENABLE_SESSION
+    throw std::runtime_error("[op-sqlite][applyChangeset] SQLite was compiled "
+                             "without SQLITE_ENABLE_SESSION");
+#else
+    if (count < 1 || !args[0].isObject() ||
+        !args[0].asObject(rt).isArrayBuffer(rt)) {
+      throw std::runtime_error(
+          "[op-sqlite][applyChangeset] changeset must be an ArrayBuffer");
+    }
+
+    auto changeset = std::get<ArrayBuffer>(to_variant(rt, args[0]));
+    std::string policy = "abort";
+    std::shared_ptr<jsi::Value> on_conflict;
+
+    if (count > 1 && args[1].isObject()) {
+      auto js_on_conflict = args[1].asObject(rt).getProperty(rt, "onConflict");
+      if (js_on_conflict.isString()) {
+        policy = js_on_conflict.asString(rt).utf8(rt);
+      } else if (js_on_conflict.isObject() &&
+                 js_on_conflict.asObject(rt).isFunction(rt)) {
+        on_conflict = std::make_shared<jsi::Value>(rt, js_on_conflict);
+      }
+    }
+
+    auto &promiseCtr = invoker->get_promise_constructor();
+    auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
+      auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
+      auto reject = std::make_shared<jsi::Value>(rt, args[1]);
+
+      if (on_conflict != nullptr) {
+        auto application = std::make_shared<ChangesetApplication>(
+            ChangesetApplication{.changeset = changeset,
+                                 .on_conflict = on_conflict,
+                                 .resolve = resolve,
+                                 .reject = reject});
+        _queue->queueWork(
+            [this, application] { apply_changeset_round(application); });
+        return {};
+      }
+
+      auto task = [this, &rt, changeset, policy, resolve, reject]() {
+        try {
+          opsqlite_apply_changeset(
+              db, changeset,
+              [&](int conflict_type, sqlite3_changeset_iter *iterator) {
+                return to_changeset_action(policy, conflict_type);
+              });
+
+          if (invalidated) {
+            return;
+          }
+
+          invoker->invokeAsync([&rt, resolve] {
+            resolve->asObject(rt).asFunction(rt).call(rt, {});
+          });
+        } catch (std::exception &exc) {
+          if (invalidated) {
+            return;
+          }
+
+          invoker->invokeAsync([&rt, what = std::string(exc.what()), reject] {
+            auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
+            auto error = errorCtr.callAsConstructor(
+                rt, jsi::String::createFromUtf8(rt, what));
+            reject->asObject(rt).asFunction(rt).call(rt, error);
+          });
+        }
+      };
+
+      _queue->queueWork(task);
+
+      return {};
+    }));
+
+    return promise;
+#endif
+  });
+
   function_map["loadExtension"] = HOSTFN("loadExtension") {
     auto path = args[0].asString(rt).utf8(rt);
     std::string entry_point;
@@ -671,17 +1897,32 @@ void DBHostObject::create_jsi_functions() {
     const std::string query_str =
         query.getProperty(rt, "query").asString(rt).utf8(rt);
     auto js_args = query.getProperty(rt, "arguments");
-    auto js_discriminators =
-        query.getProperty(rt, "fireOn").asObject(rt).asArray(rt);
+    auto js_fire_on = query.getProperty(rt, "fireOn");
     auto variant_args = to_variant_vec(rt, js_args);
 
-    sqlite3_stmt *stmt = opsqlite_prepare_statement(db, query_str);
-    opsqlite_bind_statement(stmt, &variant_args);
-
     auto callback =
         std::make_shared<jsi::Value>(query.getProperty(rt, "callback"));
 
     std::vector<TableRowDiscriminator> discriminators;
+    sqlite3_stmt *stmt;
+
+    // Without fireOn the query fires on changes of the columns it reads
+    if (js_fire_on.isUndefined()) {
+      std::unordered_map<std::string, uint64_t> reads;
+      stmt = opsqlite_prepare_tracking_reads(db, query_str, &reads);
+
+      for (const auto &[table, columns] : reads) {
+        // e.g. SELECT count(*) FROM t only cares about inserts and deletes
+        discriminators.push_back({table, {}, columns});
+      }
+    } else {
+      stmt = opsqlite_prepare_statement(db, query_str);
+    }
+    opsqlite_bind_statement(stmt, &variant_args);
+
+    auto js_discriminators = js_fire_on.isUndefined()
+                                 ? jsi::Array(rt, 0)
+                                 : js_fire_on.asObject(rt).asArray(rt);
 
     for (size_t i = 0; i < js_discriminators.length(rt); i++) {
       auto js_discriminator =
@@ -704,9 +1945,35 @@ void DBHostObject::create_jsi_functions() {
         std::make_shared<ReactiveQuery>(
             ReactiveQuery{stmt, discriminators, callback});
 
+    auto js_key = query.getProperty(rt, "key");
+    if (!js_key.isUndefined()) {
+      auto key = js_key.asString(rt).utf8(rt);
+      int column_count = sqlite3_column_count(stmt);
+      for (int i = 0; i < column_count; i++) {
+        if (key == sqlite3_column_name(stmt, i)) {
+          reactiveQuery->key_column = i;
+          break;
+        }
+      }
+
+      if (reactiveQuery->key_column < 0) {
+        sqlite3_finalize(stmt);
+        throw std::runtime_error("[op-sqlite][reactiveExecute] key column " +
+                                 key + " is not part of the result");
+      }
+    }
+
+    auto js_coalesce_ms = query.getProperty(rt, "coalesceMs");
+    if (js_coalesce_ms.isNumber()) {
+      reactiveQuery->coalesce_ms = js_coalesce_ms.asNumber();
+    }
+
     reactive_queries.push_back(reactiveQuery);
+    _queue->queueWork(
+        [this, queries = reactive_queries] { index_reactive_queries(queries); });
 
     auto_register_update_hook();
+    auto_register_commit_hook();
 
     auto unsubscribe = HOSTFN("unsubscribe") {
       auto it = std::find(reactive_queries.begin(), reactive_queries.end(),
@@ -714,14 +1981,74 @@ void DBHostObject::create_jsi_functions() {
       if (it != reactive_queries.end()) {
         reactive_queries.erase(it);
       }
+      _queue->queueWork([this, queries = reactive_queries] {
+        index_reactive_queries(queries);
+      });
       auto_register_update_hook();
+      auto_register_commit_hook();
       return {};
     });
 
     return unsubscribe;
   });
+
+  function_map["getStatementCacheStats"] = HOSTFN("getStatementCacheStats") {
+    auto stats = opsqlite_get_statement_cache_stats(db);
+
+    auto res = jsi::Object(rt);
+    res.setProperty(rt, "hits", jsi::Value(static_cast<double>(stats.hits)));
+    res.setProperty(rt, "misses",
+                    jsi::Value(static_cast<double>(stats.misses)));
+    res.setProperty(rt, "size", jsi::Value(static_cast<double>(stats.size)));
+    res.setProperty(rt, "capacity",
+                    jsi::Value(static_cast<double>(stats.capacity)));
+    return res;
+  });
+
+  function_map["openCursor"] = HOSTFN("openCursor") {
+    const std::string query = args[0].asString(rt).utf8(rt);
+    std::vector<JSVariant> params;
+
+    if (count == 2) {
+      params = to_variant_vec(rt, args[1]);
+    }
+
+    auto cursor = std::make_shared<CursorHostObject>(
+        db, query, std::move(params), invoker, _queue, is_closed);
+
+    return jsi::Object::createFromHostObject(rt, cursor);
+  });
+
+  function_map["beginTransaction"] = HOSTFN("beginTransaction") {
+    auto transaction =
+        std::make_shared<TransactionHostObject>(db, invoker, _queue);
+
+    // Queues BEGIN IMMEDIATE now, or once the open transaction is done
+    transaction->start_after(last_transaction);
+    last_transaction = transaction;
+
+    return jsi::Object::createFromHostObject(rt, transaction);
+  });
 #endif
 
+  function_map["getQueueStats"] = HOSTFN("getQueueStats") {
+    auto res = jsi::Object(rt);
+    const char *lanes[] = {"interactive", "normal", "background"};
+
+    for (int lane = 0; lane < PRIORITY_COUNT; lane++) {
+      size_t depth = _queue->getDepth(static_cast<Priority>(lane));
+#ifndef OP_SQLITE_USE_LIBSQL
+      for (auto &reader : readers) {
+        depth += reader.queue->getDepth(static_cast<Priority>(lane));
+      }
+#endif
+      res.setProperty(rt, lanes[lane],
+                      jsi::Value(static_cast<double>(depth)));
+    }
+
+    return res;
+  });
+
   function_map["prepareStatement"] = HOSTFN("prepareStatement") {
     auto query = args[0].asString(rt).utf8(rt);
 #ifdef OP_SQLITE_USE_LIBSQL
@@ -731,7 +2058,7 @@ void DBHostObject::create_jsi_functions() {
 #endif
     auto preparedStatementHostObject =
         std::make_shared<PreparedStatementHostObject>(db, db_name, statement,
-                                                      invoker, _thread_pool);
+                                                      invoker, _queue);
 
     return jsi::Object::createFromHostObject(rt, preparedStatementHostObject);
   });
@@ -762,7 +2089,7 @@ void DBHostObject::create_jsi_functions() {
 
   function_map["flushPendingReactiveQueries"] =
       HOSTFN("flushPendingReactiveQueries") {
-    auto promiseCtr = rt.global().getPropertyAsFunction(rt, "Promise");
+    auto &promiseCtr = invoker->get_promise_constructor();
     auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
       auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
 
@@ -770,7 +2097,7 @@ void DBHostObject::create_jsi_functions() {
         flush_pending_reactive_queries(resolve);
       };
 
-      _thread_pool->queueWork(task);
+      _queue->queueWork(task);
 
       return {};
     }));
@@ -809,10 +2136,16 @@ void DBHostObject::set(jsi::Runtime &_rt, const jsi::PropNameID &name,
 
 void DBHostObject::invalidate() {
   invalidated = true;
-  _thread_pool->restartPool();
 #ifdef OP_SQLITE_USE_LIBSQL
-    opsqlite_libsql_close(db);
+  _queue->waitFinished();
+  opsqlite_libsql_close(db);
 #else
+  *is_closed = true;
+  // Readers forward writes to the main queue, they have to be done first
+  close_readers();
+  _queue->waitFinished();
+  last_transaction.reset();
+  close_sessions();
   if (db != nullptr) {
     opsqlite_close(db);
     db = nullptr;
@@ -1,10 +1,10 @@
 #pragma once
 
+#include "JSCallInvoker.h"
 #include "ThreadPool.h"
 #include "types.h"
-#include <ReactCommon/CallInvoker.h>
+#include <atomic>
 #include <jsi/jsi.h>
-#include <set>
 #ifdef OP_SQLITE_USE_LIBSQL
 #include "libsql/bridge.h"
 #else
@@ -18,6 +18,28 @@ namespace opsqlite {
 namespace jsi = facebook::jsi;
 namespace react = facebook::react;
 
+/// Operation of an update hook event, as sent to JS
+enum UpdateOperation : uint8_t {
+  UPDATE_OPERATION_INSERT,
+  UPDATE_OPERATION_DELETE,
+  UPDATE_OPERATION_UPDATE
+};
+
+/// Savepoint statement run on the connection, see on_savepoint
+enum SavepointOperation : uint8_t {
+  SAVEPOINT_OPERATION_BEGIN,
+  SAVEPOINT_OPERATION_RELEASE,
+  SAVEPOINT_OPERATION_ROLLBACK_TO
+};
+
+/// Update hook events of the open transaction, sent to JS at once when it
+/// commits. Event i is on table table_ids[i]
+struct UpdateHookBatch {
+  std::vector<uint32_t> table_ids;
+  std::vector<uint8_t> operations;
+  std::vector<int64_t> row_ids;
+};
+
 struct PendingReactiveInvocation {
   std::string db_name;
   std::string table;
@@ -27,32 +49,89 @@ struct PendingReactiveInvocation {
 struct TableRowDiscriminator {
   std::string table;
   std::vector<int> ids;
+  /// Columns the query reads, updates that leave them untouched are skipped
+  uint64_t columns = ~0ULL;
 };
 
+#ifndef OP_SQLITE_USE_LIBSQL
+class ChangeCapture;
+struct ChangeBatch;
+struct ChangesetApplication;
+class SessionHostObject;
+class TransactionHostObject;
+
+struct SavepointMark {
+  std::string name;
+  size_t change_position;
+  size_t update_position;
+};
+
+/// Read only connection with its own queue, see the readers open option
+struct ReaderConnection {
+  sqlite3 *db;
+  std::shared_ptr<SerialQueue> queue;
+};
+#endif
+
 struct ReactiveQuery {
 #ifndef OP_SQLITE_USE_LIBSQL
   sqlite3_stmt *stmt;
 #endif
   std::vector<TableRowDiscriminator> discriminators;
   std::shared_ptr<jsi::Value> callback;
+  /// Already queued to be re-run on the next flush
+  bool is_pending = false;
+  /// Column of the result identifying a row, -1 to send the whole result.
+  /// With a key only the rows inserted, updated or removed since the last
+  /// emission are sent
+  int key_column = -1;
+  /// Changes committed within this delay after the first one share a re-run
+  double coalesce_ms = 0;
+  bool is_scheduled = false;
+  bool has_emitted = false;
+  /// Values of the rows of the last emission, only read on the database
+  /// thread
+  std::vector<std::vector<JSVariant>> last_rows;
+};
+
+#ifndef OP_SQLITE_USE_LIBSQL
+struct ReactiveSubscription {
+  std::shared_ptr<ReactiveQuery> query;
+  uint64_t columns;
+};
+
+/// Reactive queries of one table, indexed so a changed row is matched in
+/// constant time
+struct ReactiveTable {
+  /// Queries that fire on any row, only matched on flush
+  std::vector<ReactiveSubscription> table_subscriptions;
+  std::unordered_map<long long, std::vector<ReactiveSubscription>>
+      row_subscriptions;
+  /// Id of the table, see DBHostObject::intern_table
+  size_t id;
+  /// Changes since the last flush
+  uint64_t changed_columns = 0;
+  bool rows_changed = false;
 };
+#endif
 
 class JSI_EXPORT DBHostObject : public jsi::HostObject {
 public:
   // Normal constructor shared between all backends
   DBHostObject(jsi::Runtime &rt, std::string &base_path,
-               std::shared_ptr<react::CallInvoker> invoker,
+               std::shared_ptr<JSCallInvoker> invoker,
                std::string &db_name, std::string &path,
                std::string &crsqlite_path, std::string &sqlite_vec_path,
-               std::string &encryption_key);
+               std::string &encryption_key, size_t statement_cache_size,
+               size_t reader_count);
 
 #ifdef OP_SQLITE_USE_LIBSQL
   // Constructor for remoteOpen, purely for remote databases
   DBHostObject(jsi::Runtime &rt, std::string &url, std::string &auth_token,
-               std::shared_ptr<react::CallInvoker> invoker);
+               std::shared_ptr<JSCallInvoker> invoker);
 
   // Constructor for a local database with remote sync
-  DBHostObject(jsi::Runtime &rt, std::shared_ptr<react::CallInvoker> invoker,
+  DBHostObject(jsi::Runtime &rt, std::shared_ptr<JSCallInvoker> invoker,
                std::string &db_name, std::string &path, std::string &url,
                std::string &auth_token, int sync_interval);
 #endif
@@ -61,24 +140,67 @@ public:
   jsi::Value get(jsi::Runtime &rt, const jsi::PropNameID &propNameID) override;
   void set(jsi::Runtime &rt, const jsi::PropNameID &name,
            const jsi::Value &value) override;
-  void on_update(const std::string &table, const std::string &operation,
+  void on_update(char const *table, UpdateOperation operation,
                  long long row_id);
   void on_commit();
   void on_rollback();
+#ifndef OP_SQLITE_USE_LIBSQL
+  /// Called from the preupdate hook with the columns the next UPDATE changes
+  void on_update_columns(uint64_t columns);
+  /// Called from the preupdate hook for every changed row
+  void on_change(sqlite3 *connection, int operation, char const *table,
+                 sqlite3_int64 old_row_id, sqlite3_int64 new_row_id);
+  /// Called from the statement trace, a ROLLBACK TO forgets the changes and
+  /// update hook events seen since its savepoint
+  void on_savepoint(SavepointOperation operation, std::string const &name);
+  /// Called from the statement trace of the writer once a statement is done
+  void on_transaction_state(bool is_open);
+#endif
   void invalidate();
   ~DBHostObject() override;
 
 private:
-  std::set<std::shared_ptr<ReactiveQuery>> pending_reactive_queries;
+  std::vector<std::shared_ptr<ReactiveQuery>> pending_reactive_queries;
   void auto_register_update_hook();
+  void auto_register_commit_hook();
   void create_jsi_functions();
   void
   flush_pending_reactive_queries(const std::shared_ptr<jsi::Value> &resolve);
+#ifndef OP_SQLITE_USE_LIBSQL
+  /// Queues a task that runs the query, on a reader connection when the
+  /// readers are enabled and the query only reads. The task has to use
+  /// connection() instead of db
+  void queue_read(std::string const &query, Task task, Priority priority);
+  sqlite3 *connection();
+  void close_readers();
+  /// Sessions have to be deleted before the connection is closed
+  void close_sessions();
+  /// Drops the sessions already closed
+  bool has_open_sessions();
+  /// Runs on the database thread, so the index is only touched there
+  void
+  index_reactive_queries(const std::vector<std::shared_ptr<ReactiveQuery>> &queries);
+  /// Id of a table name, only called on the database thread
+  size_t intern_table(char const *table);
+  void send_update_hook_batch();
+  void send_change_batch();
+  void queue_reactive_query(const std::shared_ptr<ReactiveQuery> &query);
+  void run_reactive_query(const std::shared_ptr<ReactiveQuery> &query);
+  /// Re-runs the query once its coalescing window is over
+  void schedule_reactive_query(const std::shared_ptr<ReactiveQuery> &query);
+  /// Queues the re-run of the pending queries behind the work already queued
+  void queue_reactive_flush();
+  /// Applies the changeset with the conflict decisions made so far. New
+  /// conflicts are omitted and the attempt rolled back, JS decides on them
+  /// and the changeset is applied again. Runs on the database thread
+  void apply_changeset_round(
+      const std::shared_ptr<ChangesetApplication> &application);
+#endif
 
   std::unordered_map<std::string, jsi::Value> function_map;
   std::string base_path;
-  std::shared_ptr<react::CallInvoker> invoker;
-  std::shared_ptr<ThreadPool> _thread_pool;
+  std::shared_ptr<JSCallInvoker> invoker;
+  std::shared_ptr<SerialQueue> _queue;
   std::string db_name;
   std::shared_ptr<jsi::Value> update_hook_callback;
   std::shared_ptr<jsi::Value> commit_hook_callback;
@@ -87,11 +209,49 @@ private:
   std::vector<std::shared_ptr<ReactiveQuery>> reactive_queries;
   std::vector<PendingReactiveInvocation> pending_reactive_invocations;
   bool is_update_hook_registered = false;
+  bool is_preupdate_hook_registered = false;
+  bool is_following_savepoints = false;
   bool invalidated = false;
 #ifdef OP_SQLITE_USE_LIBSQL
   DB db;
 #else
   sqlite3 *db;
+  std::vector<ReaderConnection> readers;
+  size_t next_reader = 0;
+  // Shared with the cursors, set once the connection is closed
+  std::shared_ptr<std::atomic<bool>> is_closed =
+      std::make_shared<std::atomic<bool>>(false);
+  // Transactions wait for the one begun before them
+  std::shared_ptr<TransactionHostObject> last_transaction;
+  // Set by the statement trace of the writer, reads go to the writer while
+  // it has a transaction open so they see its uncommitted changes
+  std::atomic<bool> is_writer_in_transaction{false};
+  // Columns changed by the UPDATE being reported, all of them when the
+  // preupdate hook is not available
+  uint64_t changed_columns = ~0ULL;
+  // Interned table names, an id is never reused so the index can be rebuilt
+  // while tables are dirty
+  std::unordered_map<std::string, size_t> table_ids;
+  std::vector<std::string> table_names;
+  // Rows of a statement usually hit the same table
+  std::string last_table;
+  size_t last_table_id = 0;
+  // Indexed by table id
+  std::vector<ReactiveTable> reactive_tables;
+  // Tables changed since the last flush
+  std::vector<size_t> dirty_reactive_tables;
+  // A flush is queued behind the last commit
+  bool is_reactive_flush_queued = false;
+  UpdateHookBatch update_hook_batch;
+  // Set on the JS thread, keeps the hooks registered
+  std::shared_ptr<jsi::Value> change_hook_callback;
+  // Swapped on the database thread
+  std::shared_ptr<ChangeCapture> change_capture;
+  // Open savepoints of the transaction, with the captured changes and update
+  // hook events they start at. Only touched on the database thread
+  std::vector<SavepointMark> savepoint_marks;
+  // Deleted before the connection is closed
+  std::vector<std::weak_ptr<SessionHostObject>> sessions;
 #endif
 };
 
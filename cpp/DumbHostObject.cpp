@@ -7,6 +7,44 @@ namespace opsqlite {
 
 namespace jsi = facebook::jsi;
 
+ColumnIndex::ColumnIndex(jsi::Runtime &rt,
+                         std::vector<SmartHostObject> const &metadata) {
+  names.reserve(metadata.size());
+  positions.reserve(metadata.size());
+
+  for (size_t i = 0; i < metadata.size(); i++) {
+    auto &name = std::get<std::string>(metadata[i].fields[0].second);
+    names.emplace_back(jsi::PropNameID::forUtf8(rt, name));
+    positions[name] = static_cast<int>(i);
+  }
+
+  resolved.reserve(metadata.size());
+  for (size_t i = 0; i < metadata.size(); i++) {
+    resolved.push_back(
+        positions[std::get<std::string>(metadata[i].fields[0].second)]);
+  }
+}
+
+int ColumnIndex::find(jsi::Runtime &rt, const jsi::PropNameID &name) {
+  // Rows are usually read column after column, the one after the last hit is
+  // compared first and the last column is followed by the first one of the
+  // next row. Property names are interned by the runtime, comparing them
+  // does not allocate
+  int position;
+  if (next < names.size() && jsi::PropNameID::compare(rt, names[next], name)) {
+    position = resolved[next];
+  } else {
+    auto it = positions.find(name.utf8(rt));
+    if (it == positions.end()) {
+      return -1;
+    }
+    position = it->second;
+  }
+
+  next = (static_cast<size_t>(position) + 1) % names.size();
+  return position;
+}
+
 DumbHostObject::DumbHostObject(
     std::shared_ptr<std::vector<SmartHostObject>> metadata) {
   this->metadata = metadata;
@@ -14,12 +52,15 @@ DumbHostObject::DumbHostObject(
 
 std::vector<jsi::PropNameID>
 DumbHostObject::getPropertyNames(jsi::Runtime &rt) {
+  if (index == nullptr) {
+    index = std::make_shared<ColumnIndex>(rt, *metadata);
+  }
+
   std::vector<jsi::PropNameID> keys;
+  keys.reserve(index->names.size());
 
-  for (auto field : *metadata) {
-    // TODO improve this by generating the propName once on metadata creation
-    keys.push_back(jsi::PropNameID::forAscii(
-        rt, std::get<std::string>(field.fields[0].second)));
+  for (auto &name : index->names) {
+    keys.emplace_back(rt, name);
   }
 
   return keys;
@@ -27,19 +68,24 @@ DumbHostObject::getPropertyNames(jsi::Runtime &rt) {
 
 jsi::Value DumbHostObject::get(jsi::Runtime &rt,
                                const jsi::PropNameID &propNameID) {
+  if (index == nullptr) {
+    index = std::make_shared<ColumnIndex>(rt, *metadata);
+  }
 
-  auto name = propNameID.utf8(rt);
-  auto fields = metadata.get();
-  for (int i = 0; i < fields->size(); i++) {
-    auto fieldName = std::get<std::string>(fields->at(i).fields[0].second);
-    if (fieldName == name) {
-      return to_jsi(rt, values.at(i));
-    }
+  int position = index->find(rt, propNameID);
+  if (position >= 0) {
+    // Read on every access, each read gets its own blob
+    return to_jsi(rt, values.at(position), true);
   }
 
-  for (auto pairField : ownValues) {
+  if (ownValues.empty()) {
+    return {};
+  }
+
+  auto name = propNameID.utf8(rt);
+  for (auto &pairField : ownValues) {
     if (name == pairField.first) {
-      return to_jsi(rt, pairField.second);
+      return to_jsi(rt, pairField.second, true);
     }
   }
 
@@ -48,17 +94,18 @@ jsi::Value DumbHostObject::get(jsi::Runtime &rt,
 
 void DumbHostObject::set(jsi::Runtime &rt, const jsi::PropNameID &name,
                          const jsi::Value &value) {
-  auto key = name.utf8(rt);
-  auto fields = metadata.get();
-  for (int i = 0; i < fields->size(); i++) {
-    auto fieldName = std::get<std::string>(fields->at(i).fields[0].second);
-    if (fieldName == key) {
-      values[i] = to_variant(rt, value);
-      return;
-    }
+  if (index == nullptr) {
+    index = std::make_shared<ColumnIndex>(rt, *metadata);
   }
 
-  for (auto pairField : ownValues) {
+  int position = index->find(rt, name);
+  if (position >= 0) {
+    values[position] = to_variant(rt, value);
+    return;
+  }
+
+  auto key = name.utf8(rt);
+  for (auto &pairField : ownValues) {
     if (key == pairField.first) {
       pairField.second = to_variant(rt, value);
       return;
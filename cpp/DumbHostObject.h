@@ -5,12 +5,33 @@
 #include <any>
 #include <jsi/jsi.h>
 #include <stdio.h>
+#include <unordered_map>
 #include <vector>
 
 namespace opsqlite {
 
 namespace jsi = facebook::jsi;
 
+/// Column lookup shared by all the rows of a result. It is built once on the
+/// JS thread, reading a property does not scan the metadata. Only used on the
+/// JS thread
+struct ColumnIndex {
+  ColumnIndex(jsi::Runtime &rt, std::vector<SmartHostObject> const &metadata);
+
+  /// Position of the column named like the property, -1 when there is none
+  int find(jsi::Runtime &rt, const jsi::PropNameID &name);
+
+  std::vector<jsi::PropNameID> names;
+
+private:
+  // Like a plain object, the last column with a repeated name wins
+  std::unordered_map<std::string, int> positions;
+  // Position each entry of names resolves to
+  std::vector<int> resolved;
+  // Entry of names tried before converting the property to a string
+  size_t next = 0;
+};
+
 class JSI_EXPORT DumbHostObject : public jsi::HostObject {
 public:
   DumbHostObject() = default;
@@ -29,6 +50,9 @@ public:
 
   std::shared_ptr<std::vector<SmartHostObject>> metadata;
 
+  // Set when the row is handed to JS, see create_result
+  std::shared_ptr<ColumnIndex> index;
+
   std::vector<std::pair<std::string, JSVariant>> ownValues;
 };
 
@@ -0,0 +1,58 @@
+#include "JSCallInvoker.h"
+
+namespace opsqlite {
+
+jsi::Function const &JSCallInvoker::get_promise_constructor() {
+  if (promise_constructor == nullptr) {
+    promise_constructor = std::make_unique<jsi::Function>(
+        rt.global().getPropertyAsFunction(rt, "Promise"));
+  }
+
+  return *promise_constructor;
+}
+
+void JSCallInvoker::invalidate() {
+  std::lock_guard<std::mutex> lock(mutex);
+  invalidated = true;
+  pending.clear();
+  promise_constructor.reset();
+}
+
+void JSCallInvoker::schedule_drain() {
+  invoker->invokeAsync(
+      [weak_self = weak_from_this()] {
+        if (auto self = weak_self.lock()) {
+          self->drain();
+        }
+      });
+}
+
+void JSCallInvoker::drain() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::swap(pending, draining);
+    scheduled = false;
+  }
+
+  // One failing closure does not prevent the rest from running, the first
+  // error is rethrown once they are done
+  std::exception_ptr error;
+
+  for (auto &closure : draining) {
+    try {
+      closure();
+    } catch (...) {
+      if (error == nullptr) {
+        error = std::current_exception();
+      }
+    }
+  }
+
+  draining.clear();
+
+  if (error != nullptr) {
+    std::rethrow_exception(error);
+  }
+}
+
+} // namespace opsqlite
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "ThreadPool.h"
+#include <ReactCommon/CallInvoker.h>
+#include <jsi/jsi.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace opsqlite {
+
+namespace jsi = facebook::jsi;
+namespace react = facebook::react;
+
+/// Runs closures on the JS thread of a runtime. Closures queued while a drain
+/// is already scheduled are collected and run together, so many queries
+/// finishing at the same time cost a single hop to the JS thread and their
+/// promises all resolve in the same JS turn
+class JSCallInvoker : public std::enable_shared_from_this<JSCallInvoker> {
+public:
+  JSCallInvoker(jsi::Runtime &rt, std::shared_ptr<react::CallInvoker> invoker)
+      : rt(rt), invoker(std::move(invoker)) {};
+
+  template <typename F> void invokeAsync(F &&closure) {
+    bool is_idle;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (invalidated) {
+        return;
+      }
+      pending.emplace_back(std::forward<F>(closure));
+      is_idle = !scheduled;
+      scheduled = true;
+    }
+
+    if (is_idle) {
+      schedule_drain();
+    }
+  }
+
+  /// The global Promise constructor, looked up once per runtime. Only call
+  /// from the JS thread
+  jsi::Function const &get_promise_constructor();
+
+  /// Drops pending closures and the cached JS values, the runtime is going
+  /// away
+  void invalidate();
+
+private:
+  void schedule_drain();
+  void drain();
+
+  jsi::Runtime &rt;
+  std::shared_ptr<react::CallInvoker> invoker;
+  std::mutex mutex;
+  // Filled by the workers, swapped with draining by the JS thread so both
+  // vectors keep their capacity
+  std::vector<Task> pending;
+  std::vector<Task> draining;
+  bool scheduled = false;
+  bool invalidated = false;
+  std::unique_ptr<jsi::Function> promise_constructor;
+};
+
+} // namespace opsqlite
@@ -31,7 +31,7 @@ jsi::Value PreparedStatementHostObject::get(jsi::Runtime &rt,
       const jsi::Value &js_params = args[0];
       std::vector<JSVariant> params = to_variant_vec(rt, js_params);
 
-      auto promiseCtr = rt.global().getPropertyAsFunction(rt, "Promise");
+      auto &promiseCtr = _js_call_invoker->get_promise_constructor();
       auto promise = promiseCtr.callAsConstructor(
           rt, HOSTFN("executor") {
         auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
@@ -39,6 +39,7 @@ jsi::Value PreparedStatementHostObject::get(jsi::Runtime &rt,
         auto task = [&rt, this, resolve, reject,
                      invoker = this->_js_call_invoker, params]() {
           try {
+            std::lock_guard<std::mutex> lock(_mutex);
 #ifdef OP_SQLITE_USE_LIBSQL
             opsqlite_libsql_bind_statement(_stmt, &params);
 #else
@@ -64,7 +65,7 @@ jsi::Value PreparedStatementHostObject::get(jsi::Runtime &rt,
           }
         };
 
-        _thread_pool->queueWork(task);
+        _queue->queueWork(task);
 
         return {};
           }));
@@ -78,7 +79,7 @@ jsi::Value PreparedStatementHostObject::get(jsi::Runtime &rt,
         throw std::runtime_error("statement has been freed");
       }
 
-      auto promiseCtr = rt.global().getPropertyAsFunction(rt, "Promise");
+      auto &promiseCtr = _js_call_invoker->get_promise_constructor();
         auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
         auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
         auto reject = std::make_shared<jsi::Value>(rt, args[1]);
@@ -89,6 +90,7 @@ jsi::Value PreparedStatementHostObject::get(jsi::Runtime &rt,
           std::shared_ptr<std::vector<SmartHostObject>> metadata =
               std::make_shared<std::vector<SmartHostObject>>();
           try {
+            std::lock_guard<std::mutex> lock(_mutex);
 #ifdef OP_SQLITE_USE_LIBSQL
             auto status = opsqlite_libsql_execute_prepared_statement(
                 _db, _stmt, &results, metadata);
@@ -116,7 +118,7 @@ jsi::Value PreparedStatementHostObject::get(jsi::Runtime &rt,
           }
         };
 
-        _thread_pool->queueWork(task);
+        _queue->queueWork(task);
 
         return {};
           }));
@@ -125,9 +127,149 @@ jsi::Value PreparedStatementHostObject::get(jsi::Runtime &rt,
     });
   }
 
+  if (name == "run" || name == "runRaw") {
+    bool is_raw = name == "runRaw";
+    return HOSTFN("run") {
+      if (_stmt == nullptr) {
+        throw std::runtime_error("statement has been freed");
+      }
+
+      std::shared_ptr<std::vector<JSVariant>> params;
+      if (count > 0 && args[0].isObject()) {
+        params = std::make_shared<std::vector<JSVariant>>(
+            to_variant_vec(rt, args[0]));
+      }
+
+      return queue_run(rt, std::move(params), is_raw);
+    });
+  }
+
+  if (name == "runSync") {
+    return HOSTFN("runSync") {
+      if (_stmt == nullptr) {
+        throw std::runtime_error("statement has been freed");
+      }
+
+      std::vector<JSVariant> params;
+      bool has_params = count > 0 && args[0].isObject();
+      if (has_params) {
+        params = to_variant_vec(rt, args[0]);
+      }
+
+      auto status = run(has_params ? &params : nullptr);
+      return create_js_rows(rt, status);
+    });
+  }
+
+  if (name == "runMany") {
+    return HOSTFN("runMany") {
+      if (_stmt == nullptr) {
+        throw std::runtime_error("statement has been freed");
+      }
+
+      if (count < 1 || !args[0].isObject() ||
+          !args[0].asObject(rt).isArray(rt)) {
+        throw std::runtime_error(
+            "[op-sqlite][runMany] params must be an array of arrays");
+      }
+
+      auto js_params = args[0].asObject(rt).asArray(rt);
+      auto params = std::make_shared<std::vector<std::vector<JSVariant>>>();
+      params->reserve(js_params.length(rt));
+      for (size_t i = 0; i < js_params.length(rt); i++) {
+        params->push_back(
+            to_variant_vec(rt, js_params.getValueAtIndex(rt, i)));
+      }
+
+      auto &promiseCtr = _js_call_invoker->get_promise_constructor();
+      auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
+        auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
+        auto reject = std::make_shared<jsi::Value>(rt, args[1]);
+
+        auto task = [&rt, this, resolve, reject,
+                     invoker = this->_js_call_invoker, params]() {
+          try {
+            std::lock_guard<std::mutex> lock(_mutex);
+#ifdef OP_SQLITE_USE_LIBSQL
+            auto result = opsqlite_libsql_run_statement_many(_db, _stmt, *params);
+#else
+            auto result = opsqlite_run_statement_many(_db, _stmt, *params);
+#endif
+            invoker->invokeAsync([&rt, result, resolve] {
+              auto res = jsi::Object(rt);
+              res.setProperty(rt, "rowsAffected",
+                              jsi::Value(result.affectedRows));
+              resolve->asObject(rt).asFunction(rt).call(rt, std::move(res));
+            });
+          } catch (std::exception &exc) {
+            invoker->invokeAsync([&rt, what = std::string(exc.what()),
+                                  reject] {
+              auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
+              auto error = errorCtr.callAsConstructor(
+                  rt, jsi::String::createFromUtf8(rt, what));
+              reject->asObject(rt).asFunction(rt).call(rt, error);
+            });
+          }
+        };
+
+        _queue->queueWork(task);
+
+        return {};
+      }));
+
+      return promise;
+    });
+  }
+
   return {};
 }
 
+BridgeResult
+PreparedStatementHostObject::run(const std::vector<JSVariant> *params) {
+  std::lock_guard<std::mutex> lock(_mutex);
+#ifdef OP_SQLITE_USE_LIBSQL
+  return opsqlite_libsql_run_statement(_db, _stmt, params);
+#else
+  return opsqlite_run_statement(_db, _stmt, params);
+#endif
+}
+
+jsi::Value PreparedStatementHostObject::queue_run(
+    jsi::Runtime &rt, std::shared_ptr<std::vector<JSVariant>> params,
+    bool is_raw) {
+  auto &promiseCtr = _js_call_invoker->get_promise_constructor();
+  return promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
+    auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
+    auto reject = std::make_shared<jsi::Value>(rt, args[1]);
+
+    // Binds and steps in a single task, one round trip per run
+    auto task = [&rt, this, resolve, reject, params, is_raw,
+                 invoker = this->_js_call_invoker]() {
+      try {
+        auto status = run(params.get());
+
+        invoker->invokeAsync([&rt, status = std::move(status), is_raw,
+                              resolve] {
+          auto res = is_raw ? create_raw_result(rt, status)
+                            : create_js_rows(rt, status);
+          resolve->asObject(rt).asFunction(rt).call(rt, std::move(res));
+        });
+      } catch (std::exception &exc) {
+        invoker->invokeAsync([&rt, what = std::string(exc.what()), reject] {
+          auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
+          auto error = errorCtr.callAsConstructor(
+              rt, jsi::String::createFromUtf8(rt, what));
+          reject->asObject(rt).asFunction(rt).call(rt, error);
+        });
+      }
+    };
+
+    _queue->queueWork(task);
+
+    return {};
+  }));
+}
+
 PreparedStatementHostObject::~PreparedStatementHostObject() {
 #ifdef OP_SQLITE_USE_LIBSQL
   if (_stmt != nullptr) {
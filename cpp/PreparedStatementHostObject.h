@@ -1,6 +1,6 @@
 #pragma once
 
-#include <ReactCommon/CallInvoker.h>
+#include "JSCallInvoker.h"
 #include <jsi/jsi.h>
 #include <memory>
 #ifdef OP_SQLITE_USE_LIBSQL
@@ -10,8 +10,11 @@
 #include <sqlite3.h>
 #endif
 #include "ThreadPool.h"
+#include "types.h"
+#include <mutex>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace opsqlite {
 namespace jsi = facebook::jsi;
@@ -22,17 +25,17 @@ public:
 #ifdef OP_SQLITE_USE_LIBSQL
   PreparedStatementHostObject(
       DB const &db, std::string name, libsql_stmt_t stmt,
-      std::shared_ptr<react::CallInvoker> js_call_invoker,
-      std::shared_ptr<ThreadPool> thread_pool)
+      std::shared_ptr<JSCallInvoker> js_call_invoker,
+      std::shared_ptr<SerialQueue> queue)
       : _db(db), _name(std::move(name)), _stmt(stmt), _js_call_invoker(js_call_invoker),
-        _thread_pool(thread_pool) {};
+        _queue(queue) {};
 #else
   PreparedStatementHostObject(
       sqlite3 *db, std::string name, sqlite3_stmt *stmt,
-      std::shared_ptr<react::CallInvoker> js_call_invoker,
-      std::shared_ptr<ThreadPool> thread_pool)
+      std::shared_ptr<JSCallInvoker> js_call_invoker,
+      std::shared_ptr<SerialQueue> queue)
       : _db(db), _name(std::move(name)), _stmt(stmt), _js_call_invoker(std::move(js_call_invoker)),
-        _thread_pool(std::move(thread_pool)) {};
+        _queue(std::move(queue)) {};
 #endif
   ~PreparedStatementHostObject() override;
 
@@ -41,6 +44,14 @@ public:
   jsi::Value get(jsi::Runtime &rt, const jsi::PropNameID &propNameID) override;
 
 private:
+  /// Runs the statement on the calling thread, params nullptr keeps the
+  /// values bound before
+  BridgeResult run(const std::vector<JSVariant> *params);
+  /// Queues run and resolves with its rows, as objects or as arrays
+  jsi::Value queue_run(jsi::Runtime &rt,
+                       std::shared_ptr<std::vector<JSVariant>> params,
+                       bool is_raw);
+
   std::string _name;
 #ifdef OP_SQLITE_USE_LIBSQL
   DB _db;
@@ -50,8 +61,11 @@ private:
   // This shouldn't be de-allocated until sqlite3_finalize is called on it
   sqlite3_stmt *_stmt;
 #endif
-  std::shared_ptr<react::CallInvoker> _js_call_invoker;
-  std::shared_ptr<ThreadPool> _thread_pool;
+  std::shared_ptr<JSCallInvoker> _js_call_invoker;
+  std::shared_ptr<SerialQueue> _queue;
+  // runSync uses the statement from the JS thread, the lock keeps it from
+  // being reset under a run on the database thread
+  std::mutex _mutex;
 };
 
 } // namespace opsqlite
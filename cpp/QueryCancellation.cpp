@@ -0,0 +1,68 @@
+#include "QueryCancellation.h"
+#include <stdexcept>
+
+namespace opsqlite {
+
+thread_local QueryCancellation *CancellationScope::current = nullptr;
+
+QueryCancellation::QueryCancellation(double timeout_ms)
+    : has_deadline(timeout_ms > 0) {
+  if (has_deadline) {
+    deadline =
+        std::chrono::steady_clock::now() +
+        std::chrono::microseconds(static_cast<int64_t>(timeout_ms * 1000));
+  }
+}
+
+void QueryCancellation::cancel() {
+  cancelled = true;
+
+#ifndef OP_SQLITE_USE_LIBSQL
+  std::lock_guard<std::mutex> lock(mutex);
+  if (connection != nullptr) {
+    sqlite3_interrupt(connection);
+  }
+#endif
+}
+
+bool QueryCancellation::is_expired() const {
+  return cancelled ||
+         (has_deadline && std::chrono::steady_clock::now() >= deadline);
+}
+
+const char *QueryCancellation::reason() const {
+  return cancelled ? "[op-sqlite] query cancelled"
+                   : "[op-sqlite] query timed out";
+}
+
+CancellationScope::CancellationScope(
+    const std::shared_ptr<QueryCancellation> &cancellation,
+    sqlite3 *connection)
+    : cancellation(cancellation.get()) {
+  if (this->cancellation == nullptr) {
+    return;
+  }
+
+  {
+    // cancel sets the flag before taking the lock, it either is seen here or
+    // sees the connection
+    std::lock_guard<std::mutex> lock(this->cancellation->mutex);
+    if (this->cancellation->is_expired()) {
+      throw std::runtime_error(this->cancellation->reason());
+    }
+    this->cancellation->connection = connection;
+  }
+  current = this->cancellation;
+}
+
+CancellationScope::~CancellationScope() {
+  if (cancellation == nullptr) {
+    return;
+  }
+
+  current = nullptr;
+  std::lock_guard<std::mutex> lock(cancellation->mutex);
+  cancellation->connection = nullptr;
+}
+
+} // namespace opsqlite
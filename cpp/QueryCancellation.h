@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <sqlite3.h>
+
+namespace opsqlite {
+
+/// Shared between a queued query and the cancel function JS got for it. A
+/// query cancelled or past its deadline before it starts is dropped, one
+/// already running is interrupted
+class QueryCancellation {
+public:
+  /// No deadline when timeout_ms is 0
+  explicit QueryCancellation(double timeout_ms);
+
+  /// Can be called from any thread
+  void cancel();
+  bool is_expired() const;
+  /// Error the query is rejected with once expired
+  const char *reason() const;
+
+private:
+  friend class CancellationScope;
+
+  std::atomic<bool> cancelled{false};
+  bool has_deadline;
+  std::chrono::steady_clock::time_point deadline;
+  // Guards connection, so a connection is never interrupted once the query
+  // is done with it
+  std::mutex mutex;
+  sqlite3 *connection = nullptr;
+};
+
+/// Marks a query as running on the current thread for the lifetime of the
+/// scope. Throws when the query expired before it could start
+class CancellationScope {
+public:
+  CancellationScope(const std::shared_ptr<QueryCancellation> &cancellation,
+                    sqlite3 *connection = nullptr);
+  ~CancellationScope();
+
+  /// Query running on the current thread, read by the progress handler
+  static thread_local QueryCancellation *current;
+
+private:
+  QueryCancellation *cancellation;
+};
+
+} // namespace opsqlite
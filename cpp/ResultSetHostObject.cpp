@@ -0,0 +1,132 @@
+#include "ResultSetHostObject.h"
+#include "macros.h"
+#include "utils.h"
+
+namespace opsqlite {
+
+namespace jsi = facebook::jsi;
+
+std::vector<jsi::PropNameID>
+ResultSetHostObject::getPropertyNames(jsi::Runtime &rt) {
+  std::vector<jsi::PropNameID> keys;
+
+  keys.emplace_back(jsi::PropNameID::forAscii(rt, "length"));
+  keys.emplace_back(jsi::PropNameID::forAscii(rt, "rowsAffected"));
+  keys.emplace_back(jsi::PropNameID::forAscii(rt, "insertId"));
+  keys.emplace_back(jsi::PropNameID::forAscii(rt, "columnNames"));
+
+  return keys;
+}
+
+size_t ResultSetHostObject::to_row_index(jsi::Runtime &rt,
+                                         const jsi::Value &value) {
+  if (_freed) {
+    throw std::runtime_error("[op-sqlite] result set has been freed");
+  }
+
+  if (!value.isNumber()) {
+    throw std::runtime_error("[op-sqlite] row index must be a number");
+  }
+
+  double index = value.asNumber();
+  if (index < 0 || index >= _result.rows.size()) {
+    throw std::runtime_error("[op-sqlite] row index out of bounds");
+  }
+
+  return static_cast<size_t>(index);
+}
+
+size_t ResultSetHostObject::to_column_index(jsi::Runtime &rt,
+                                            const jsi::Value &value) {
+  if (value.isNumber()) {
+    double index = value.asNumber();
+    if (index < 0 || index >= _result.column_names.size()) {
+      throw std::runtime_error("[op-sqlite] column index out of bounds");
+    }
+    return static_cast<size_t>(index);
+  }
+
+  if (value.isString()) {
+    auto name = value.asString(rt).utf8(rt);
+    for (size_t i = 0; i < _result.column_names.size(); i++) {
+      if (_result.column_names[i] == name) {
+        return i;
+      }
+    }
+    throw std::runtime_error("[op-sqlite] unknown column " + name);
+  }
+
+  throw std::runtime_error(
+      "[op-sqlite] column must be an index or a column name");
+}
+
+jsi::Value ResultSetHostObject::get(jsi::Runtime &rt,
+                                    const jsi::PropNameID &propNameID) {
+  auto name = propNameID.utf8(rt);
+
+  if (name == "length") {
+    return jsi::Value(static_cast<double>(_freed ? 0 : _result.rows.size()));
+  }
+
+  if (name == "rowsAffected") {
+    return jsi::Value(_result.affectedRows);
+  }
+
+  if (name == "insertId") {
+    if (_result.affectedRows > 0 && _result.insertId != 0) {
+      return jsi::Value(_result.insertId);
+    }
+    return {};
+  }
+
+  if (name == "columnNames") {
+    auto column_names = jsi::Array(rt, _result.column_names.size());
+    for (size_t i = 0; i < _result.column_names.size(); i++) {
+      column_names.setValueAtIndex(
+          rt, i, jsi::String::createFromUtf8(rt, _result.column_names[i]));
+    }
+    return column_names;
+  }
+
+  if (name == "getRow") {
+    return HOSTFN("getRow") {
+      size_t row = to_row_index(rt, args[0]);
+
+      if (_column_ids.empty()) {
+        _column_ids = create_column_ids(rt, _result.column_names);
+      }
+      if (_strings.empty()) {
+        _strings = create_row_strings(_result.rows);
+      }
+
+      // Rows can be read again, every read gets its own blobs
+      return create_row(rt, _result.rows, row, _column_ids, _strings, true);
+    });
+  }
+
+  if (name == "getValue") {
+    return HOSTFN("getValue") {
+      size_t row = to_row_index(rt, args[0]);
+      size_t column = to_column_index(rt, args[1]);
+
+      if (_strings.empty()) {
+        _strings = create_row_strings(_result.rows);
+      }
+
+      return create_cell(rt, _result.rows, row, column, _strings, true);
+    });
+  }
+
+  if (name == "free") {
+    return HOSTFN("free") {
+      _freed = true;
+      _result.rows = RowArena();
+      _strings.clear();
+      return {};
+    });
+  }
+
+  return {};
+}
+
+} // namespace opsqlite
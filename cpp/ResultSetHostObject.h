@@ -0,0 +1,34 @@
+#pragma once
+
+#include "types.h"
+#include <jsi/jsi.h>
+#include <memory>
+#include <vector>
+
+namespace opsqlite {
+
+namespace jsi = facebook::jsi;
+
+/// Keeps the rows of a query in native memory and only converts the rows JS
+/// asks for, a query costs one allocation no matter how many rows it returns
+class JSI_EXPORT ResultSetHostObject : public jsi::HostObject {
+public:
+  explicit ResultSetHostObject(BridgeResult result)
+      : _result(std::move(result)) {};
+
+  std::vector<jsi::PropNameID> getPropertyNames(jsi::Runtime &rt) override;
+
+  jsi::Value get(jsi::Runtime &rt, const jsi::PropNameID &propNameID) override;
+
+private:
+  size_t to_row_index(jsi::Runtime &rt, const jsi::Value &value);
+  size_t to_column_index(jsi::Runtime &rt, const jsi::Value &value);
+
+  BridgeResult _result;
+  bool _freed = false;
+  // Created the first time a row is read, they belong to the JS thread
+  std::vector<jsi::PropNameID> _column_ids;
+  std::vector<std::vector<jsi::Value>> _strings;
+};
+
+} // namespace opsqlite
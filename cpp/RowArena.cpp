@@ -0,0 +1,122 @@
+#include "RowArena.h"
+#include <cstring>
+
+namespace opsqlite {
+
+// Payloads larger than a quarter of a block get a block of their own, so a
+// few big blobs do not waste the tail of the current block
+static const size_t BLOCK_SIZE = 64 * 1024;
+// Longer values are rarely repeated, hashing them is not worth it
+static const size_t MAX_DICTIONARY_TEXT_SIZE = 64;
+// Once this many values of a column have been looked up, the dictionary is
+// dropped if less than half of them were repeats
+static const size_t DICTIONARY_SAMPLE_SIZE = 1024;
+
+void RowArena::push_null() {
+  Cell cell;
+  cell.type = CELL_NULL;
+  cell.size = 0;
+  cell.block = 0;
+  cell.entry = NO_ENTRY;
+  cell.data = nullptr;
+  cells.push_back(cell);
+}
+
+void RowArena::push_number(double value) {
+  Cell cell;
+  cell.type = CELL_NUMBER;
+  cell.size = 0;
+  cell.block = 0;
+  cell.entry = NO_ENTRY;
+  cell.number = value;
+  cells.push_back(cell);
+}
+
+void RowArena::push_text(const char *text, size_t size) {
+  Cell cell;
+  cell.type = CELL_TEXT;
+  cell.size = static_cast<uint32_t>(size);
+  cell.entry = NO_ENTRY;
+
+  Dictionary &dictionary = dictionaries[cells.size() % column_count];
+
+  // Checked once, whether the sample ends on a hit or on a miss
+  if (dictionary.enabled && !dictionary.is_sampled &&
+      dictionary.lookups >= DICTIONARY_SAMPLE_SIZE) {
+    dictionary.is_sampled = true;
+    if (dictionary.entries.size() > DICTIONARY_SAMPLE_SIZE / 2) {
+      // Entry ids handed out so far stay valid
+      dictionary.enabled = false;
+      dictionary.entries.clear();
+    }
+  }
+
+  bool is_encoded = dictionary.enabled && size <= MAX_DICTIONARY_TEXT_SIZE;
+
+  if (is_encoded) {
+    auto it = dictionary.entries.find(std::string_view(text, size));
+    dictionary.lookups++;
+
+    if (it != dictionary.entries.end()) {
+      cell.entry = it->second.id;
+      cell.block = it->second.block;
+      cell.data = reinterpret_cast<const uint8_t *>(it->first.data());
+      cells.push_back(cell);
+      return;
+    }
+  }
+
+  uint8_t *data = allocate(size, &cell.block);
+  if (size > 0) {
+    memcpy(data, text, size);
+  }
+  cell.data = data;
+
+  if (is_encoded) {
+    cell.entry = dictionary.size++;
+    dictionary.entries.emplace(
+        std::string_view(reinterpret_cast<const char *>(data), size),
+        DictionaryEntry{.id = cell.entry, .block = cell.block});
+  }
+
+  cells.push_back(cell);
+}
+
+void RowArena::push_blob(const void *blob, size_t size) {
+  Cell cell;
+  cell.type = CELL_BLOB;
+  cell.size = static_cast<uint32_t>(size);
+  cell.entry = NO_ENTRY;
+
+  // Its own allocation, handed over to JS as is
+  blocks.emplace_back(new uint8_t[size]);
+  cell.block = static_cast<uint32_t>(blocks.size() - 1);
+  uint8_t *data = blocks.back().get();
+  if (size > 0) {
+    memcpy(data, blob, size);
+  }
+  cell.data = data;
+  cells.push_back(cell);
+}
+
+uint8_t *RowArena::allocate(size_t size, uint32_t *block) {
+  if (size > BLOCK_SIZE / 4) {
+    blocks.emplace_back(new uint8_t[size]);
+    *block = static_cast<uint32_t>(blocks.size() - 1);
+    return blocks.back().get();
+  }
+
+  if (current_block == nullptr || block_used + size > BLOCK_SIZE) {
+    blocks.emplace_back(new uint8_t[BLOCK_SIZE]);
+    current_block = blocks.back().get();
+    current_block_index = static_cast<uint32_t>(blocks.size() - 1);
+    block_used = 0;
+  }
+
+  uint8_t *data = current_block + block_used;
+  block_used += size;
+  *block = current_block_index;
+  return data;
+}
+
+} // namespace opsqlite
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace opsqlite {
+
+/// Storage for the rows of a result set. Cells are kept row after row in a
+/// single vector and TEXT payloads are bump allocated in large blocks, so
+/// reading a result costs a handful of allocations instead of several per row.
+/// BLOBs get an allocation each, so an ArrayBuffer can adopt one without
+/// keeping the rest of the result alive.
+///
+/// Short TEXT values are dictionary encoded per column: a repeated value points
+/// to the payload of its first occurrence and shares its entry id, so it is
+/// neither copied nor converted to a JS string twice. Columns that turn out to
+/// have mostly distinct values stop being encoded
+class RowArena {
+public:
+  enum CellType : uint8_t { CELL_NULL, CELL_NUMBER, CELL_TEXT, CELL_BLOB };
+
+  // Entry of TEXT cells that are not dictionary encoded
+  static const uint32_t NO_ENTRY = UINT32_MAX;
+
+  struct Cell {
+    CellType type;
+    // Payload size in bytes for TEXT and BLOB cells
+    uint32_t size;
+    // Index of the block holding the payload
+    uint32_t block;
+    // Dictionary entry of TEXT cells, equal cells of a column share it
+    uint32_t entry;
+    union {
+      double number;
+      const uint8_t *data;
+    };
+  };
+
+  RowArena() = default;
+  explicit RowArena(size_t column_count)
+      : column_count(column_count), dictionaries(column_count) {}
+
+  /// Needs to be called before adding cells, an arena holds a single shape
+  void set_column_count(size_t count) {
+    column_count = count;
+    dictionaries.resize(count);
+  }
+  size_t get_column_count() const { return column_count; }
+
+  size_t size() const {
+    return column_count == 0 ? 0 : cells.size() / column_count;
+  }
+  bool empty() const { return cells.empty(); }
+
+  const Cell &at(size_t row, size_t column) const {
+    return cells[row * column_count + column];
+  }
+
+  /// The allocation of a BLOB cell, it holds nothing else
+  std::shared_ptr<uint8_t[]> const &get_block(const Cell &cell) const {
+    return blocks[cell.block];
+  }
+
+  /// Number of distinct entries of a column, entry ids are below this
+  size_t get_dictionary_size(size_t column) const {
+    return dictionaries[column].size;
+  }
+
+  void reserve_rows(size_t rows) { cells.reserve(rows * column_count); }
+
+  void push_null();
+  void push_number(double value);
+  void push_text(const char *text, size_t size);
+  void push_blob(const void *blob, size_t size);
+
+private:
+  struct DictionaryEntry {
+    uint32_t id;
+    uint32_t block;
+  };
+
+  struct Dictionary {
+    // Keys point to the payload of the first occurrence inside the arena
+    std::unordered_map<std::string_view, DictionaryEntry> entries;
+    // Number of entry ids handed out, kept once the map is dropped
+    uint32_t size = 0;
+    size_t lookups = 0;
+    bool enabled = true;
+    // The sample has been evaluated, the dictionary is kept for good
+    bool is_sampled = false;
+  };
+
+  uint8_t *allocate(size_t size, uint32_t *block);
+
+  size_t column_count = 0;
+  std::vector<Cell> cells;
+  std::vector<Dictionary> dictionaries;
+  // Payload blocks are shared so copies of a result keep pointing to valid
+  // memory without duplicating it
+  std::vector<std::shared_ptr<uint8_t[]>> blocks;
+  // Block small payloads are currently bump allocated from
+  uint8_t *current_block = nullptr;
+  uint32_t current_block_index = 0;
+  size_t block_used = 0;
+};
+
+} // namespace opsqlite
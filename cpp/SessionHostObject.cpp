@@ -0,0 +1,132 @@
+#include "SessionHostObject.h"
+#include "bridge.h"
+#include "macros.h"
+#include "utils.h"
+
+namespace opsqlite {
+
+#ifdef SQLITE_ENABLE_SESSION
+namespace jsi = facebook::jsi;
+
+std::vector<jsi::PropNameID>
+SessionHostObject::getPropertyNames(jsi::Runtime &rt) {
+  std::vector<jsi::PropNameID> keys;
+
+  return keys;
+}
+
+jsi::Value SessionHostObject::get(jsi::Runtime &rt,
+                                  const jsi::PropNameID &propNameID) {
+  auto name = propNameID.utf8(rt);
+
+  if (name == "attach") {
+    return HOSTFN("attach") {
+      if (_session == nullptr) {
+        throw std::runtime_error("[op-sqlite][attach] session is closed");
+      }
+
+      // Session calls hold the connection mutex, no need to queue it
+      if (count > 0 && args[0].isString()) {
+        auto table = args[0].asString(rt).utf8(rt);
+        opsqlite_session_attach(_session, table.c_str());
+      } else {
+        opsqlite_session_attach(_session, nullptr);
+      }
+
+      return {};
+    });
+  }
+
+  if (name == "isEmpty") {
+    return HOSTFN("isEmpty") {
+      return jsi::Value(_session == nullptr ||
+                        sqlite3session_isempty(_session) != 0);
+    });
+  }
+
+  if (name == "changeset") {
+    return HOSTFN("changeset") { return create_changeset(rt, false); });
+  }
+
+  if (name == "patchset") {
+    return HOSTFN("patchset") { return create_changeset(rt, true); });
+  }
+
+  if (name == "close") {
+    return HOSTFN("close") {
+      auto &promiseCtr = _js_call_invoker->get_promise_constructor();
+      auto promise = promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
+        auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
+
+        // Goes through the queue so pending changesets are generated first
+        auto task = [&rt, self = shared_from_this(), resolve,
+                     invoker = this->_js_call_invoker]() {
+          self->close();
+          invoker->invokeAsync([&rt, resolve] {
+            resolve->asObject(rt).asFunction(rt).call(rt, {});
+          });
+        };
+
+        _queue->queueWork(task);
+
+        return {};
+      }));
+
+      return promise;
+    });
+  }
+
+  return {};
+}
+
+jsi::Value SessionHostObject::create_changeset(jsi::Runtime &rt,
+                                               bool is_patchset) {
+  auto &promiseCtr = _js_call_invoker->get_promise_constructor();
+  return promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
+    auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
+    auto reject = std::make_shared<jsi::Value>(rt, args[1]);
+
+    // Queued so the changeset includes the writes queued before it
+    auto task = [&rt, self = shared_from_this(), resolve, reject, is_patchset,
+                 invoker = this->_js_call_invoker]() {
+      try {
+        if (self->_session == nullptr) {
+          throw std::runtime_error("[op-sqlite][changeset] session is closed");
+        }
+
+        auto changeset =
+            opsqlite_session_changeset(self->_session, is_patchset);
+
+        invoker->invokeAsync([&rt, changeset = std::move(changeset), resolve] {
+          resolve->asObject(rt).asFunction(rt).call(
+              rt, to_jsi(rt, JSVariant(changeset)));
+        });
+      } catch (std::exception &exc) {
+        invoker->invokeAsync([&rt, message = std::string(exc.what()),
+                              reject] {
+          auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
+          auto error = errorCtr.callAsConstructor(
+              rt, jsi::String::createFromUtf8(rt, message));
+          reject->asObject(rt).asFunction(rt).call(rt, error);
+        });
+      }
+    };
+
+    _queue->queueWork(task);
+
+    return {};
+  }));
+}
+
+void SessionHostObject::close() {
+  if (_session != nullptr) {
+    sqlite3session_delete(_session);
+    _session = nullptr;
+    _is_open = false;
+  }
+}
+
+SessionHostObject::~SessionHostObject() { close(); }
+#endif
+
+} // namespace opsqlite
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "JSCallInvoker.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <jsi/jsi.h>
+#include <memory>
+#include <sqlite3.h>
+#include <vector>
+
+namespace opsqlite {
+
+#ifdef SQLITE_ENABLE_SESSION
+namespace jsi = facebook::jsi;
+namespace react = facebook::react;
+
+/// Records the changes made to some tables of the main database so they can
+/// be exported as a changeset or a patchset. Changes made by any statement of
+/// the connection are recorded, including the ones of applied changesets
+class SessionHostObject : public jsi::HostObject,
+                          public std::enable_shared_from_this<SessionHostObject> {
+public:
+  SessionHostObject(sqlite3_session *session,
+                    std::shared_ptr<JSCallInvoker> js_call_invoker,
+                    std::shared_ptr<SerialQueue> queue)
+      : _session(session), _js_call_invoker(std::move(js_call_invoker)),
+        _queue(std::move(queue)) {};
+  ~SessionHostObject() override;
+
+  std::vector<jsi::PropNameID> getPropertyNames(jsi::Runtime &rt) override;
+
+  jsi::Value get(jsi::Runtime &rt, const jsi::PropNameID &propNameID) override;
+
+  /// Sessions have to be deleted before their connection is closed
+  void close();
+  /// Can be called from any thread
+  bool is_open() const { return _is_open; }
+
+private:
+  jsi::Value create_changeset(jsi::Runtime &rt, bool is_patchset);
+
+  sqlite3_session *_session;
+  // Cleared once the session is deleted, read on the JS thread
+  std::atomic<bool> _is_open{true};
+  std::shared_ptr<JSCallInvoker> _js_call_invoker;
+  std::shared_ptr<SerialQueue> _queue;
+};
+#endif
+
+} // namespace opsqlite
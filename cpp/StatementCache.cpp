@@ -0,0 +1,78 @@
+#include "StatementCache.h"
+
+namespace opsqlite {
+
+StatementCache::StatementCache(size_t capacity) : capacity(capacity) {}
+
+StatementCache::~StatementCache() { clear(); }
+
+sqlite3_stmt *StatementCache::acquire(std::string const &query) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (capacity == 0) {
+    return nullptr;
+  }
+
+  auto it = index.find(query);
+  if (it == index.end()) {
+    misses++;
+    return nullptr;
+  }
+
+  sqlite3_stmt *statement = it->second->second;
+  entries.erase(it->second);
+  index.erase(it);
+  hits++;
+
+  return statement;
+}
+
+void StatementCache::release(std::string const &query,
+                             sqlite3_stmt *statement) {
+  sqlite3_reset(statement);
+  sqlite3_clear_bindings(statement);
+
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // Another thread might have prepared and returned the same query while this
+  // statement was checked out, one copy is enough
+  if (capacity == 0 || index.count(query) != 0) {
+    sqlite3_finalize(statement);
+    return;
+  }
+
+  entries.emplace_front(query, statement);
+  index[query] = entries.begin();
+
+  evict(capacity);
+}
+
+void StatementCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  evict(0);
+}
+
+void StatementCache::set_capacity(size_t capacity) {
+  std::lock_guard<std::mutex> lock(mutex);
+  this->capacity = capacity;
+  evict(capacity);
+}
+
+StatementCacheStats StatementCache::stats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return {.hits = hits,
+          .misses = misses,
+          .size = entries.size(),
+          .capacity = capacity};
+}
+
+void StatementCache::evict(size_t max_size) {
+  while (entries.size() > max_size) {
+    auto &entry = entries.back();
+    sqlite3_finalize(entry.second);
+    index.erase(entry.first);
+    entries.pop_back();
+  }
+}
+
+} // namespace opsqlite
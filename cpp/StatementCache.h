@@ -0,0 +1,55 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <sqlite3.h>
+#include <string>
+#include <unordered_map>
+
+namespace opsqlite {
+
+struct StatementCacheStats {
+  size_t hits;
+  size_t misses;
+  size_t size;
+  size_t capacity;
+};
+
+/// Bounded LRU cache of prepared statements for a single connection, keyed by
+/// their SQL text. A statement is removed from the cache while it is being
+/// used, so two threads can never step the same statement at the same time
+class StatementCache {
+public:
+  explicit StatementCache(size_t capacity);
+  ~StatementCache();
+
+  /// Returns a reset statement for the query or nullptr on a cache miss
+  sqlite3_stmt *acquire(std::string const &query);
+
+  /// Resets the statement and puts it back in the cache, the least recently
+  /// used statement is finalized if the cache is full
+  void release(std::string const &query, sqlite3_stmt *statement);
+
+  /// Finalizes all the cached statements, needs to be called on schema
+  /// changes and before closing the connection
+  void clear();
+
+  void set_capacity(size_t capacity);
+
+  StatementCacheStats stats();
+
+private:
+  typedef std::pair<std::string, sqlite3_stmt *> Entry;
+
+  void evict(size_t max_size);
+
+  size_t capacity;
+  size_t hits = 0;
+  size_t misses = 0;
+  // Most recently used statements are kept at the front
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+  std::mutex mutex;
+};
+
+} // namespace opsqlite
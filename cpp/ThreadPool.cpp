@@ -1,22 +1,73 @@
 #include "ThreadPool.h"
+#include <algorithm>
 
 namespace opsqlite {
 
-ThreadPool::ThreadPool() : done(false) {
+// Number of tasks a queue runs before going back to the pool
+static const int QUEUE_SLICE = 16;
+// Times in a row a lane with work can be passed over by higher lanes
+static const unsigned int STARVATION_CAP = 8;
+
+// Set on the pool threads, so queues made ready by a task are kept on the
+// worker that ran it
+static thread_local ThreadPool *currentPool = nullptr;
+static thread_local size_t currentWorker = 0;
+
+std::atomic<SerialQueue::Node *> SerialQueue::freeNodes{nullptr};
+thread_local SerialQueue::NodeCache SerialQueue::cachedNodes;
+
+int LaneSelector::select(const bool ready[PRIORITY_COUNT]) {
+  int lane = PRIORITY_COUNT;
+
+  for (int i = 0; i < PRIORITY_COUNT; i++) {
+    if (ready[i] && passed[i] >= STARVATION_CAP) {
+      lane = i;
+      break;
+    }
+  }
+
+  for (int i = 0; lane == PRIORITY_COUNT && i < PRIORITY_COUNT; i++) {
+    if (ready[i]) {
+      lane = i;
+    }
+  }
+
+  for (int i = lane + 1; i < PRIORITY_COUNT; i++) {
+    if (ready[i]) {
+      passed[i]++;
+    }
+  }
+
+  if (lane < PRIORITY_COUNT) {
+    passed[lane] = 0;
+  }
+
+  return lane;
+}
+
+std::shared_ptr<ThreadPool> ThreadPool::shared() {
   // This returns the number of threads supported by the system. If the
   // function can't figure out this information, it returns 0. 0 is not good,
   // so we create at least 1
-//  auto numberOfThreads = std::thread::hardware_concurrency();
-//  if (numberOfThreads == 0) {
-//    numberOfThreads = 1;
-//  }
+  //
+  // Never destroyed, queues of databases still open when the app exits keep
+  // pointing to it
+  static auto *pool =
+      new std::shared_ptr<ThreadPool>(std::make_shared<ThreadPool>(
+          std::max(std::thread::hardware_concurrency(), 1u)));
+  return *pool;
+}
+
+ThreadPool::ThreadPool(unsigned int numberOfThreads) : done(false) {
+  for (unsigned i = 0; i < numberOfThreads; ++i) {
+    workers.emplace_back(std::make_unique<Worker>());
+  }
 
-  auto numberOfThreads = 1;
   for (unsigned i = 0; i < numberOfThreads; ++i) {
     // The threads will execute the private member `doWork`. Note that we need
     // to pass a reference to the function (namespaced with the class name) as
     // the first argument, and the current object as second argument
-    threads.emplace_back(&ThreadPool::doWork, this);
+    threads.emplace_back(&ThreadPool::doWork, this, i);
   }
 }
 
@@ -24,7 +75,10 @@ ThreadPool::ThreadPool() : done(false) {
 // This will be executed if there is any exception (e.g. creating the threads)
 ThreadPool::~ThreadPool() {
   // So threads know it's time to shut down
-  done = true;
+  {
+    std::lock_guard<std::mutex> g(workQueueMutex);
+    done = true;
+  }
 
   // Wake up all the threads, so they can finish and be joined
   workQueueConditionVariable.notify_all();
@@ -38,81 +92,334 @@ ThreadPool::~ThreadPool() {
   threads.clear();
 }
 
-// This function will be called by the server every time there is a request
-// that needs to be processed by the thread pool
-void ThreadPool::queueWork(const std::function<void(void)>& task) {
-  // Grab the mutex
-  std::lock_guard<std::mutex> g(workQueueMutex);
+std::shared_ptr<SerialQueue> ThreadPool::createQueue() {
+  return std::make_shared<SerialQueue>(this);
+}
+
+void ThreadPool::schedule(std::shared_ptr<SerialQueue> queue, int lane) {
+  queue->waitingLane = lane;
+  publish(std::move(queue), lane);
+}
+
+void ThreadPool::publish(std::shared_ptr<SerialQueue> queue, int lane) {
+  // Counted before it is published, a worker taking it right away would
+  // otherwise decrement the counters below zero
+  scheduledByLane[lane]++;
+  scheduled++;
+
+  if (currentPool == this) {
+    Worker &worker = *workers[currentWorker];
+    std::lock_guard<std::mutex> g(worker.mutex);
+    worker.queues[lane].push_back(std::move(queue));
+  } else {
+    std::lock_guard<std::mutex> g(workQueueMutex);
+    workQueue[lane].push_back(std::move(queue));
+  }
+
+  // A worker going to sleep registers itself before checking scheduled, so
+  // either it sees the new queue or it is counted here
+  if (sleeping > 0) {
+    std::lock_guard<std::mutex> g(workQueueMutex);
+    workQueueConditionVariable.notify_one();
+  }
+}
+
+std::shared_ptr<SerialQueue> ThreadPool::takeQueue(size_t index) {
+  bool ready[PRIORITY_COUNT];
+  for (int lane = 0; lane < PRIORITY_COUNT; lane++) {
+    ready[lane] = scheduledByLane[lane] > 0;
+  }
+
+  // Only this worker uses its selector
+  int selected = workers[index]->selector.select(ready);
+  if (selected < PRIORITY_COUNT) {
+    auto queue = takeQueue(index, selected);
+    if (queue != nullptr) {
+      return queue;
+    }
+  }
 
-  // Push the request to the queue
-  workQueue.push(task);
+  // The counters can be behind the lists, look everywhere before sleeping
+  for (int lane = 0; lane < PRIORITY_COUNT; lane++) {
+    auto queue = takeQueue(index, lane);
+    if (queue != nullptr) {
+      return queue;
+    }
+  }
 
-  // Notify one thread that there are requests to process
-  workQueueConditionVariable.notify_one();
+  return nullptr;
 }
 
-// Function used by the threads to grab work from the queue
-void ThreadPool::doWork() {
-  // Loop while the queue is not destructing
-  while (!done) {
-    std::function<void(void)> task;
+std::shared_ptr<SerialQueue> ThreadPool::takeQueue(size_t index, int lane) {
+  std::shared_ptr<SerialQueue> queue;
+
+  {
+    Worker &worker = *workers[index];
+    std::lock_guard<std::mutex> g(worker.mutex);
+    if (!worker.queues[lane].empty()) {
+      queue = std::move(worker.queues[lane].front());
+      worker.queues[lane].pop_front();
+    }
+  }
+
+  if (queue == nullptr) {
+    std::lock_guard<std::mutex> g(workQueueMutex);
+    if (!workQueue[lane].empty()) {
+      queue = std::move(workQueue[lane].front());
+      workQueue[lane].pop_front();
+    }
+  }
+
+  // Steal the queue that has been waiting the least on another worker, the
+  // owner is about to get to the older ones
+  for (size_t i = 1; queue == nullptr && i < workers.size(); i++) {
+    Worker &victim = *workers[(index + i) % workers.size()];
+    std::lock_guard<std::mutex> g(victim.mutex);
+    if (!victim.queues[lane].empty()) {
+      queue = std::move(victim.queues[lane].back());
+      victim.queues[lane].pop_back();
+    }
+  }
 
-    // Create a scope, so we don't lock the queue for longer than necessary
-    {
+  if (queue != nullptr) {
+    scheduledByLane[lane]--;
+  }
+
+  return queue;
+}
+
+// Function used by the threads to grab work from the queues
+void ThreadPool::doWork(size_t index) {
+  currentPool = this;
+  currentWorker = index;
+
+  // Loop while the pool is not destructing
+  while (true) {
+    auto queue = takeQueue(index);
+
+    if (queue == nullptr) {
       std::unique_lock<std::mutex> g(workQueueMutex);
+      sleeping++;
       workQueueConditionVariable.wait(g, [&] {
-        // Only wake up if there are elements in the queue or the program is
-        // shutting down
-        return !workQueue.empty() || done;
+        // Only wake up if there are queues to run or the program is shutting
+        // down
+        return scheduled > 0 || done;
       });
+      sleeping--;
 
       // If we are shutting down exit without trying to process more work
       if (done) {
         break;
       }
 
-      task = workQueue.front();
-      workQueue.pop();
+      continue;
+    }
+
+    busy++;
+    scheduled--;
+
+    // A promoted queue is listed twice, the entry left behind is dropped
+    if (queue->claim()) {
+      queue->run();
+    }
+    queue.reset();
+
+    if (--busy == 0 && scheduled == 0) {
+      std::lock_guard<std::mutex> g(workQueueMutex);
+      idleConditionVariable.notify_all();
     }
-    ++busy;
-    task();
-    --busy;
   }
 }
 
 void ThreadPool::waitFinished() {
   std::unique_lock<std::mutex> g(workQueueMutex);
-  workQueueConditionVariable.wait(
-      g, [&] { return workQueue.empty() && (busy == 0); });
+  idleConditionVariable.wait(g, [&] { return scheduled == 0 && busy == 0; });
 }
 
-void ThreadPool::restartPool() {
-  // So threads know it's time to shut down
-  done = true;
+SerialQueue::~SerialQueue() {
+  // Tasks that never ran
+  for (auto &lane : lanes) {
+    while (Node *node = pop(lane)) {
+      delete node;
+    }
+  }
+}
 
-  // Wake up all the threads, so they can finish and be joined
-  workQueueConditionVariable.notify_all();
+SerialQueue::NodeCache::~NodeCache() {
+  if (nodes == nullptr) {
+    return;
+  }
 
-  for (auto &thread : threads) {
-    if (thread.joinable()) {
-      thread.join();
+  Node *last = nodes;
+  while (Node *next = last->next.load(std::memory_order_relaxed)) {
+    last = next;
+  }
+  release(nodes, last);
+}
+
+void SerialQueue::release(Node *first, Node *last) {
+  Node *free = freeNodes.load(std::memory_order_relaxed);
+  do {
+    last->next.store(free, std::memory_order_relaxed);
+  } while (!freeNodes.compare_exchange_weak(free, first,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed));
+}
+
+SerialQueue::Node *SerialQueue::takeNode() {
+  Node *node = cachedNodes.nodes;
+  if (node == nullptr) {
+    node = freeNodes.exchange(nullptr, std::memory_order_acquire);
+  }
+
+  if (node == nullptr) {
+    return new Node();
+  }
+
+  cachedNodes.nodes = node->next.load(std::memory_order_relaxed);
+  return node;
+}
+
+void SerialQueue::push(Node *node, Priority priority) {
+  lanes[priority].depth++;
+  link(lanes[priority], node);
+
+  // Only the producer that makes the queue ready hands it to the pool
+  if (!scheduled.exchange(true)) {
+    pool->schedule(shared_from_this(), priority);
+  } else {
+    promote(priority);
+  }
+}
+
+void SerialQueue::promote(Priority priority) {
+  int lane = waitingLane.load();
+  while (priority < lane && lane < PRIORITY_COUNT) {
+    if (waitingLane.compare_exchange_weak(lane, priority)) {
+      pool->publish(shared_from_this(), priority);
+      return;
     }
   }
+}
 
-  threads.clear();
+bool SerialQueue::claim() {
+  return waitingLane.exchange(PRIORITY_COUNT) < PRIORITY_COUNT;
+}
 
-  auto numberOfThreads = std::thread::hardware_concurrency();
-  if (numberOfThreads == 0) {
-    numberOfThreads = 1;
+void SerialQueue::link(Lane &lane, Node *node) {
+  node->next.store(nullptr, std::memory_order_relaxed);
+  Node *previous = lane.head.exchange(node, std::memory_order_acq_rel);
+  previous->next.store(node, std::memory_order_release);
+}
+
+SerialQueue::Node *SerialQueue::pop(Lane &lane) {
+  Node *node = lane.tail;
+  Node *next = node->next.load(std::memory_order_acquire);
+
+  if (node == &lane.stub) {
+    if (next == nullptr) {
+      return nullptr;
+    }
+    lane.tail = next;
+    node = next;
+    next = next->next.load(std::memory_order_acquire);
   }
 
-  for (unsigned i = 0; i < numberOfThreads; ++i) {
-    // The threads will execute the private member `doWork`. Note that we need
-    // to pass a reference to the function (namespaced with the class name) as
-    // the first argument, and the current object as second argument
-    threads.emplace_back(&ThreadPool::doWork, this);
+  if (next != nullptr) {
+    lane.tail = next;
+    return node;
+  }
+
+  // A producer has swapped the head but not linked its node yet
+  if (node != lane.head.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+
+  // node is the last one, the stub goes behind it so it can be detached
+  link(lane, &lane.stub);
+  next = node->next.load(std::memory_order_acquire);
+  if (next != nullptr) {
+    lane.tail = next;
+    return node;
   }
 
-  done = false;
+  return nullptr;
+}
+
+int SerialQueue::firstLane() const {
+  for (int i = 0; i < PRIORITY_COUNT; i++) {
+    if (!isEmpty(lanes[i])) {
+      return i;
+    }
+  }
+  return PRIORITY_COUNT;
 }
+
+void SerialQueue::run() {
+  for (int i = 0; i < QUEUE_SLICE; i++) {
+    bool ready[PRIORITY_COUNT];
+    for (int lane = 0; lane < PRIORITY_COUNT; lane++) {
+      ready[lane] = !isEmpty(lanes[lane]);
+    }
+
+    Node *node = nullptr;
+    int selected = selector.select(ready);
+    if (selected < PRIORITY_COUNT) {
+      node = pop(lanes[selected]);
+    }
+
+    // The selected lane can have a producer halfway through linking
+    for (int lane = 0; node == nullptr && lane < PRIORITY_COUNT; lane++) {
+      if (lane != selected) {
+        node = pop(lanes[lane]);
+        selected = lane;
+      }
+    }
+
+    if (node == nullptr) {
+      bool is_drained = true;
+      for (auto &lane : lanes) {
+        is_drained = is_drained && lane.tail == &lane.stub;
+      }
+
+      scheduled = false;
+
+      // A producer that linked its node after pop looked at the lists may
+      // have seen the queue as still scheduled. A lane is only known to be
+      // empty when it is down to its stub, tails cannot be read again as
+      // another worker may already own the queue
+      is_drained = is_drained && isDrained();
+
+      if (is_drained || scheduled.exchange(true)) {
+        if (waiting > 0) {
+          std::lock_guard<std::mutex> g(mutex);
+          idle.notify_all();
+        }
+        return;
+      }
+
+      continue;
+    }
+
+    lanes[selected].depth--;
+    node->task();
+    node->task.reset();
+    release(node, node);
+  }
+
+  int lane = firstLane();
+  pool->schedule(shared_from_this(),
+                 lane < PRIORITY_COUNT ? lane : PRIORITY_NORMAL);
+}
+
+void SerialQueue::waitFinished() {
+  std::unique_lock<std::mutex> g(mutex);
+  waiting++;
+  // The worker clears scheduled before knowing the lanes are drained and can
+  // take the queue back right after, it only counts as finished once both
+  // hold
+  idle.wait(g, [&] { return !scheduled && isDrained(); });
+  waiting--;
+}
+
 } // namespace opsqlite
@@ -1,44 +1,308 @@
 #pragma once
 
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
+#include <deque>
 #include <exception>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
 #include <stdio.h>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace opsqlite {
 
+class SerialQueue;
+
+/// Lanes tasks are queued in. Work on a higher lane runs first, e.g. a query
+/// the UI is waiting on goes ahead of a background sync
+enum Priority : uint8_t {
+  PRIORITY_INTERACTIVE,
+  PRIORITY_NORMAL,
+  PRIORITY_BACKGROUND
+};
+
+static const int PRIORITY_COUNT = 3;
+
+/// Picks the lane to serve next: the highest one with work, unless a lower
+/// lane has been passed over too many times in a row, then it gets a turn
+class LaneSelector {
+public:
+  /// Returns PRIORITY_COUNT when no lane is ready
+  int select(const bool ready[PRIORITY_COUNT]);
+
+private:
+  unsigned int passed[PRIORITY_COUNT] = {};
+};
+
+/// Move only callable. Lambdas up to INLINE_SIZE bytes are stored inside the
+/// task instead of on the heap. A Task is bigger than that, a lambda wrapping
+/// another one has to hold it by pointer
+class Task {
+public:
+  static const size_t INLINE_SIZE = 128;
+
+  Task() = default;
+
+  template <typename F, typename = std::enable_if_t<
+                            !std::is_same_v<std::decay_t<F>, Task>>>
+  Task(F &&callable) {
+    emplace(std::forward<F>(callable));
+  }
+
+  Task(Task &&other) noexcept { take(other); }
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      reset();
+      take(other);
+    }
+    return *this;
+  }
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() { reset(); }
+
+  void operator()() { ops->invoke(storage); }
+
+  explicit operator bool() const { return ops != nullptr; }
+
+  /// Replaces the callable, constructing the new one in place
+  template <typename F> void emplace(F &&callable) {
+    using Callable = std::decay_t<F>;
+    reset();
+
+    if constexpr (sizeof(Callable) <= INLINE_SIZE &&
+                  alignof(Callable) <= alignof(std::max_align_t)) {
+      new (storage) Callable(std::forward<F>(callable));
+      ops = &inline_ops<Callable>;
+    } else {
+      *reinterpret_cast<Callable **>(storage) =
+          new Callable(std::forward<F>(callable));
+      ops = &heap_ops<Callable>;
+    }
+  }
+
+  void reset() {
+    if (ops != nullptr) {
+      ops->destroy(storage);
+      ops = nullptr;
+    }
+  }
+
+private:
+  struct Ops {
+    void (*invoke)(void *storage);
+    // Moves the callable to an empty storage and destroys the moved from one
+    void (*move)(void *destination, void *source);
+    void (*destroy)(void *storage);
+  };
+
+  template <typename Callable>
+  static constexpr Ops inline_ops = {
+      [](void *storage) { (*static_cast<Callable *>(storage))(); },
+      [](void *destination, void *source) {
+        new (destination) Callable(std::move(*static_cast<Callable *>(source)));
+        static_cast<Callable *>(source)->~Callable();
+      },
+      [](void *storage) { static_cast<Callable *>(storage)->~Callable(); }};
+
+  template <typename Callable>
+  static constexpr Ops heap_ops = {
+      [](void *storage) { (**static_cast<Callable **>(storage))(); },
+      [](void *destination, void *source) {
+        *static_cast<Callable **>(destination) =
+            *static_cast<Callable **>(source);
+      },
+      [](void *storage) { delete *static_cast<Callable **>(storage); }};
+
+  void take(Task &other) {
+    if (other.ops != nullptr) {
+      other.ops->move(storage, other.storage);
+      ops = other.ops;
+      other.ops = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char storage[INLINE_SIZE];
+  const Ops *ops = nullptr;
+};
+
+/// Process wide pool of workers shared by every database. Work is scheduled
+/// as serial queues, a queue is never run by two workers at the same time.
+/// Every worker keeps its own list of queues ready to run and idle workers
+/// steal queues from the busy ones
 class ThreadPool {
 public:
-  ThreadPool();
+  /// The pool every database queues its work on, created on first use
+  static std::shared_ptr<ThreadPool> shared();
+
+  explicit ThreadPool(unsigned int numberOfThreads);
   ~ThreadPool();
-  void queueWork(const std::function<void(void)>& task);
+  /// Creates a queue running its tasks on this pool, which has to outlive it
+  std::shared_ptr<SerialQueue> createQueue();
   void waitFinished();
-  void restartPool();
 
 private:
-  unsigned int busy{};
+  friend class SerialQueue;
+
+  struct Worker {
+    std::mutex mutex;
+    // Queues made ready by this worker, it takes from the front and thieves
+    // take from the back
+    std::deque<std::shared_ptr<SerialQueue>> queues[PRIORITY_COUNT];
+    LaneSelector selector;
+  };
+
+  std::atomic<unsigned int> busy{0};
+  // Number of queues waiting to be picked up by a worker, across all lists
+  std::atomic<size_t> scheduled{0};
+  std::atomic<size_t> scheduledByLane[PRIORITY_COUNT] = {};
+  // Workers blocked on the condition variable, nobody is notified while all
+  // of them are running
+  std::atomic<unsigned int> sleeping{0};
+
   // This condition variable is used for the threads to wait until there is work
   // to do
-  std::condition_variable_any workQueueConditionVariable;
+  std::condition_variable workQueueConditionVariable;
+  // Signaled when the last running queue finishes, for waitFinished
+  std::condition_variable idleConditionVariable;
 
   // We store the threads in a vector, so we can later stop them gracefully
   std::vector<std::thread> threads;
 
-  // Mutex to protect workQueue
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  // Mutex to protect workQueue and to sleep on
   std::mutex workQueueMutex;
 
-  // Queue of requests waiting to be processed
-  std::queue<std::function<void(void)>> workQueue;
+  // Queues made ready outside of the workers (e.g. from the JS thread)
+  std::deque<std::shared_ptr<SerialQueue>> workQueue[PRIORITY_COUNT];
 
   // This will be set to true when the thread pool is shutting down. This tells
   // the threads to stop looping and finish
-  bool done;
+  std::atomic<bool> done;
+
+  // The lane is the one of the most urgent task of the queue at the time
+  void schedule(std::shared_ptr<SerialQueue> queue, int lane);
+  // Lists the queue in a lane without changing the one it waits in
+  void publish(std::shared_ptr<SerialQueue> queue, int lane);
+  std::shared_ptr<SerialQueue> takeQueue(size_t index);
+  std::shared_ptr<SerialQueue> takeQueue(size_t index, int lane);
+
+  // Function used by the threads to grab work from the queues
+  void doWork(size_t index);
+};
+
+/// Tasks of a single connection. They run one at a time, on whichever worker
+/// of the pool is free. Tasks of the same priority run in the order they were
+/// queued, across priorities the more urgent ones go first.
+///
+/// Queueing is lock free: every lane is an intrusive multi producer single
+/// consumer list, the consumer being the worker that currently owns the
+/// queue. List nodes are recycled, so queueing a task does not allocate
+/// once the app is warmed up
+class SerialQueue : public std::enable_shared_from_this<SerialQueue> {
+public:
+  explicit SerialQueue(ThreadPool *pool) : pool(pool) {};
+  ~SerialQueue();
+
+  template <typename F>
+  void queueWork(F &&task, Priority priority = PRIORITY_NORMAL) {
+    Node *node = takeNode();
+    node->task.emplace(std::forward<F>(task));
+    push(node, priority);
+  }
+  /// Blocks until every queued task has run, cannot be called from a task of
+  /// this queue
+  void waitFinished();
+  /// Number of tasks of a lane waiting to run
+  size_t getDepth(Priority priority) const {
+    return lanes[priority].depth.load(std::memory_order_relaxed);
+  }
+
+private:
+  friend class ThreadPool;
+
+  struct Node {
+    std::atomic<Node *> next{nullptr};
+    Task task;
+  };
+
+  struct Lane {
+    Node stub;
+    // Producers append at the head, the consumer takes from the tail
+    std::atomic<Node *> head;
+    Node *tail;
+    std::atomic<size_t> depth{0};
+
+    Lane() : head(&stub), tail(&stub) {}
+  };
+
+  // Nodes of finished tasks. Workers push them one by one and producers take
+  // the whole list at once, neither operation is subject to ABA
+  static std::atomic<Node *> freeNodes;
+  // Nodes taken from freeNodes by the current thread, only it touches them.
+  // They go back to freeNodes when the thread exits
+  struct NodeCache {
+    Node *nodes = nullptr;
+    ~NodeCache();
+  };
+  static thread_local NodeCache cachedNodes;
+
+  static void release(Node *first, Node *last);
+  static void link(Lane &lane, Node *node);
+  // Only called by the worker owning the queue, returns nullptr when the
+  // lane is empty or a producer is halfway through linking its node
+  static Node *pop(Lane &lane);
+  static bool isEmpty(const Lane &lane) {
+    return lane.tail == &lane.stub &&
+           lane.stub.next.load(std::memory_order_acquire) == nullptr;
+  }
+
+  // True when every lane is down to its stub, readable from any thread.
+  // Nodes a producer is still linking count as queued
+  bool isDrained() const {
+    for (auto &lane : lanes) {
+      if (lane.head.load(std::memory_order_acquire) != &lane.stub) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  Node *takeNode();
+  void push(Node *node, Priority priority);
+  // Moves the waiting queue to a more urgent lane
+  void promote(Priority priority);
+  // False when another entry of the queue was taken first
+  bool claim();
+  // Most urgent lane with tasks, PRIORITY_COUNT if there are none
+  int firstLane() const;
+
+  // Runs a slice of the queued tasks and hands the queue back to the pool if
+  // there are more, so a busy database does not starve the others
+  void run();
 
-  // Function used by the threads to grab work from the queue
-  void doWork();
+  ThreadPool *pool;
+  Lane lanes[PRIORITY_COUNT];
+  // Only used by the worker owning the queue
+  LaneSelector selector;
+  // Set while the queue is waiting in the pool or running on a worker
+  std::atomic<bool> scheduled{false};
+  // Lane the queue is waiting in, PRIORITY_COUNT while it runs or is idle. A
+  // more urgent task lowers it and lists the queue again in its lane, the
+  // worker taking one of the entries first runs the queue
+  std::atomic<int> waitingLane{PRIORITY_COUNT};
+  std::atomic<unsigned int> waiting{0};
+  std::mutex mutex;
+  std::condition_variable idle;
 };
 
-} // namespace opsqlite
\ No newline at end of file
+} // namespace opsqlite
@@ -0,0 +1,250 @@
+#include "TransactionHostObject.h"
+#include "bridge.h"
+#include "macros.h"
+#include "utils.h"
+
+namespace opsqlite {
+
+namespace jsi = facebook::jsi;
+
+std::vector<jsi::PropNameID>
+TransactionHostObject::getPropertyNames(jsi::Runtime &rt) {
+  std::vector<jsi::PropNameID> keys;
+
+  return keys;
+}
+
+void TransactionHostObject::start_after(
+    const std::shared_ptr<TransactionHostObject> &previous) {
+  // A finished transaction that never started still has its COMMIT held
+  if (previous == nullptr || (previous->_started && previous->_finished)) {
+    start();
+    return;
+  }
+
+  previous->_next = shared_from_this();
+}
+
+void TransactionHostObject::start() {
+  _started = true;
+
+  queue([self = shared_from_this()] {
+    try {
+      opsqlite_execute(self->_db, "BEGIN IMMEDIATE", nullptr);
+      self->_begun = true;
+    } catch (std::exception &exc) {
+      self->_failure = exc.what();
+    }
+  });
+
+  for (auto &task : _held) {
+    _queue->queueWork(std::move(task));
+  }
+  _held.clear();
+
+  // Committed or rolled back while waiting, the COMMIT or ROLLBACK has just
+  // been queued
+  if (_finished) {
+    start_next();
+  }
+}
+
+void TransactionHostObject::finish() {
+  _finished = true;
+  _depth = 0;
+
+  // Otherwise start passes the connection on once it queued the held tasks
+  if (_started) {
+    start_next();
+  }
+}
+
+void TransactionHostObject::start_next() {
+  // The next transaction is queued behind our COMMIT or ROLLBACK
+  if (_next != nullptr) {
+    _next->start();
+    _next.reset();
+  }
+}
+
+void TransactionHostObject::queue(Task task) {
+  if (_started) {
+    _queue->queueWork(std::move(task));
+  } else {
+    _held.push_back(std::move(task));
+  }
+}
+
+jsi::Value TransactionHostObject::queue_step(jsi::Runtime &rt,
+                                             TransactionStep step,
+                                             std::string query,
+                                             std::vector<JSVariant> params) {
+  auto &promiseCtr = _js_call_invoker->get_promise_constructor();
+  return promiseCtr.callAsConstructor(rt, HOSTFN("executor") {
+    auto resolve = std::make_shared<jsi::Value>(rt, args[0]);
+    auto reject = std::make_shared<jsi::Value>(rt, args[1]);
+
+    queue([&rt, self = shared_from_this(), step, query, params, resolve,
+           reject, invoker = _js_call_invoker] {
+      try {
+        auto status = self->run_step(step, query, &params);
+
+        invoker->invokeAsync([&rt, status = std::move(status), resolve] {
+          auto jsiResult = create_js_rows(rt, status);
+          resolve->asObject(rt).asFunction(rt).call(rt, std::move(jsiResult));
+        });
+      } catch (std::exception &exc) {
+        invoker->invokeAsync(
+            [&rt, message = std::string(exc.what()), reject] {
+              auto errorCtr = rt.global().getPropertyAsFunction(rt, "Error");
+              auto error = errorCtr.callAsConstructor(
+                  rt, jsi::String::createFromUtf8(rt, message));
+              reject->asObject(rt).asFunction(rt).call(rt, error);
+            });
+      }
+    });
+
+    return {};
+  }));
+}
+
+BridgeResult TransactionHostObject::run_step(
+    TransactionStep step, std::string const &query,
+    const std::vector<JSVariant> *params) {
+  if (step == TRANSACTION_ROLLBACK) {
+    // Nothing to undo if BEGIN failed
+    rollback_if_open();
+    return BridgeResult{.affectedRows = 0, .insertId = 0};
+  }
+
+  if (!_failure.empty()) {
+    if (step == TRANSACTION_COMMIT) {
+      rollback_if_open();
+    }
+    throw std::runtime_error(_failure);
+  }
+
+  if (step != TRANSACTION_COMMIT) {
+    return opsqlite_execute(_db, query, params);
+  }
+
+  try {
+    return opsqlite_execute(_db, "COMMIT", nullptr);
+  } catch (...) {
+    // e.g. a deferred foreign key failed, do not leave the connection inside
+    // the transaction
+    rollback_if_open();
+    throw;
+  }
+}
+
+void TransactionHostObject::rollback_if_open() {
+  // A transaction opened by someone else is left alone when BEGIN failed
+  if (_begun && !sqlite3_get_autocommit(_db)) {
+    opsqlite_execute(_db, "ROLLBACK", nullptr);
+  }
+}
+
+void TransactionHostObject::check_active() {
+  if (_finished) {
+    throw std::runtime_error(
+        "[op-sqlite] transaction has already been committed or rolled back");
+  }
+}
+
+jsi::Value TransactionHostObject::get(jsi::Runtime &rt,
+                                      const jsi::PropNameID &propNameID) {
+  auto name = propNameID.utf8(rt);
+
+  if (name == "execute") {
+    return HOSTFN("execute") {
+      check_active();
+
+      std::string query = args[0].asString(rt).utf8(rt);
+      std::vector<JSVariant> params = count >= 2 && args[1].isObject()
+                                          ? to_variant_vec(rt, args[1])
+                                          : std::vector<JSVariant>();
+
+      return queue_step(rt, TRANSACTION_STATEMENT, std::move(query),
+                        std::move(params));
+    });
+  }
+
+  if (name == "savepoint") {
+    return HOSTFN("savepoint") {
+      check_active();
+
+      std::string query = "SAVEPOINT op_sqlite_" + std::to_string(++_depth);
+
+      queue([self = shared_from_this(), query] {
+        if (!self->_failure.empty()) {
+          return;
+        }
+
+        try {
+          opsqlite_execute(self->_db, query, nullptr);
+        } catch (std::exception &exc) {
+          self->_failure = exc.what();
+        }
+      });
+
+      return {};
+    });
+  }
+
+  if (name == "release") {
+    return HOSTFN("release") {
+      check_active();
+      if (_depth == 0) {
+        throw std::runtime_error("[op-sqlite][release] no savepoint is open");
+      }
+
+      std::string savepoint = "op_sqlite_" + std::to_string(_depth--);
+
+      return queue_step(rt, TRANSACTION_STATEMENT, "RELEASE " + savepoint, {});
+    });
+  }
+
+  if (name == "rollbackToSavepoint") {
+    return HOSTFN("rollbackToSavepoint") {
+      check_active();
+      if (_depth == 0) {
+        throw std::runtime_error(
+            "[op-sqlite][rollbackToSavepoint] no savepoint is open");
+      }
+
+      std::string savepoint = "op_sqlite_" + std::to_string(_depth--);
+
+      // Rolling back to a savepoint leaves it open
+      return queue_step(rt, TRANSACTION_STATEMENT,
+                        "ROLLBACK TO " + savepoint + "; RELEASE " + savepoint,
+                        {});
+    });
+  }
+
+  if (name == "commit") {
+    return HOSTFN("commit") {
+      check_active();
+
+      auto promise = queue_step(rt, TRANSACTION_COMMIT, "", {});
+      finish();
+
+      return promise;
+    });
+  }
+
+  if (name == "rollback") {
+    return HOSTFN("rollback") {
+      check_active();
+
+      auto promise = queue_step(rt, TRANSACTION_ROLLBACK, "", {});
+      finish();
+
+      return promise;
+    });
+  }
+
+  return {};
+}
+
+} // namespace opsqlite
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "JSCallInvoker.h"
+#include "ThreadPool.h"
+#include "types.h"
+#include <jsi/jsi.h>
+#include <memory>
+#include <sqlite3.h>
+#include <string>
+#include <vector>
+
+namespace opsqlite {
+
+namespace jsi = facebook::jsi;
+
+enum TransactionStep {
+  TRANSACTION_STATEMENT,
+  TRANSACTION_COMMIT,
+  TRANSACTION_ROLLBACK
+};
+
+/// Write transaction held on the database thread. BEGIN IMMEDIATE, the
+/// statements, savepoints and the final COMMIT or ROLLBACK are queued as soon
+/// as JS calls them, without waiting for the previous one to come back.
+///
+/// Transactions of a database run one after the other: the statements of a
+/// transaction started while another one is open are held until that one is
+/// committed or rolled back. Everything but the task bodies runs on the JS
+/// thread
+class TransactionHostObject
+    : public jsi::HostObject,
+      public std::enable_shared_from_this<TransactionHostObject> {
+public:
+  TransactionHostObject(sqlite3 *db,
+                        std::shared_ptr<JSCallInvoker> js_call_invoker,
+                        std::shared_ptr<SerialQueue> queue)
+      : _db(db), _js_call_invoker(std::move(js_call_invoker)),
+        _queue(std::move(queue)) {};
+
+  std::vector<jsi::PropNameID> getPropertyNames(jsi::Runtime &rt) override;
+
+  jsi::Value get(jsi::Runtime &rt, const jsi::PropNameID &propNameID) override;
+
+  /// Begins the transaction once previous is done with the connection
+  void start_after(const std::shared_ptr<TransactionHostObject> &previous);
+
+private:
+  void start();
+  void finish();
+  void start_next();
+  void queue(Task task);
+  void check_active();
+  jsi::Value queue_step(jsi::Runtime &rt, TransactionStep step,
+                        std::string query, std::vector<JSVariant> params);
+  // Only called from the database thread
+  BridgeResult run_step(TransactionStep step, std::string const &query,
+                        const std::vector<JSVariant> *params);
+  void rollback_if_open();
+
+  sqlite3 *_db;
+  std::shared_ptr<JSCallInvoker> _js_call_invoker;
+  std::shared_ptr<SerialQueue> _queue;
+  bool _started = false;
+  bool _finished = false;
+  // Open savepoints
+  int _depth = 0;
+  // Tasks queued before the transaction started
+  std::vector<Task> _held;
+  // Started as soon as this one finishes
+  std::shared_ptr<TransactionHostObject> _next;
+  // Set on the database thread once BEGIN IMMEDIATE succeeded
+  bool _begun = false;
+  // Set on the database thread when BEGIN or a SAVEPOINT failed, the
+  // remaining statements are rejected with it
+  std::string _failure;
+};
+
+} // namespace opsqlite
@@ -23,6 +23,7 @@ std::string _base_path;
 std::string _crsqlite_path;
 std::string _sqlite_vec_path;
 std::vector<std::shared_ptr<DBHostObject>> dbs;
+std::shared_ptr<JSCallInvoker> _js_call_invoker;
 
 // React native will try to clean the module on JS context invalidation
 // (CodePush/Hot Reload) The clearState function is called
@@ -34,6 +35,11 @@ void invalidate() {
   // Clear our existing vector of shared pointers so they can be garbage
   // collected
   dbs.clear();
+
+  if (_js_call_invoker != nullptr) {
+    _js_call_invoker->invalidate();
+    _js_call_invoker.reset();
+  }
 }
 
 void install(jsi::Runtime &rt,
@@ -43,6 +49,7 @@ void install(jsi::Runtime &rt,
   _base_path = std::string(base_path);
   _crsqlite_path = std::string(crsqlite_path);
   _sqlite_vec_path = std::string(sqlite_vec_path);
+  _js_call_invoker = std::make_shared<JSCallInvoker>(rt, invoker);
 
   auto open = HOST_STATIC_FN("open") {
     jsi::Object options = args[0].asObject(rt);
@@ -60,6 +67,23 @@ void install(jsi::Runtime &rt,
           options.getProperty(rt, "encryptionKey").asString(rt).utf8(rt);
     }
 
+    size_t statement_cache_size = DEFAULT_STATEMENT_CACHE_SIZE;
+    if (options.hasProperty(rt, "statementCacheSize")) {
+      statement_cache_size = to_count(
+          rt, options.getProperty(rt, "statementCacheSize"),
+          "statementCacheSize");
+    }
+
+    size_t reader_count = 0;
+    if (options.hasProperty(rt, "readers")) {
+      reader_count =
+          to_count(rt, options.getProperty(rt, "readers"), "readers");
+      if (reader_count > MAX_READERS) {
+        throw std::runtime_error("[op-sqlite] readers cannot be more than " +
+                                 std::to_string(MAX_READERS));
+      }
+    }
+
 #ifdef OP_SQLITE_USE_SQLCIPHER
     if (encryption_key.empty()) {
       log_to_console(rt, "Encryption key is missing for SQLCipher");
@@ -77,8 +101,9 @@ void install(jsi::Runtime &rt,
     }
 
     std::shared_ptr<DBHostObject> db = std::make_shared<DBHostObject>(
-        rt, path, invoker, name, path, _crsqlite_path, _sqlite_vec_path,
-        encryption_key);
+        rt, path, _js_call_invoker, name, path, _crsqlite_path,
+        _sqlite_vec_path,
+        encryption_key, statement_cache_size, reader_count);
     dbs.emplace_back(db);
     return jsi::Object::createFromHostObject(rt, db);
   });
@@ -115,7 +140,7 @@ void install(jsi::Runtime &rt,
         options.getProperty(rt, "authToken").asString(rt).utf8(rt);
 
     std::shared_ptr<DBHostObject> db =
-        std::make_shared<DBHostObject>(rt, url, auth_token, invoker);
+        std::make_shared<DBHostObject>(rt, url, auth_token, _js_call_invoker);
     return jsi::Object::createFromHostObject(rt, db);
   });
 
@@ -148,7 +173,7 @@ void install(jsi::Runtime &rt,
     }
 
     std::shared_ptr<DBHostObject> db = std::make_shared<DBHostObject>(
-        rt, invoker, name, path, url, auth_token, sync_interval);
+        rt, _js_call_invoker, name, path, url, auth_token, sync_interval);
     return jsi::Object::createFromHostObject(rt, db);
   });
 #endif
@@ -5,13 +5,19 @@
 #include "bridge.h"
 #include "DBHostObject.h"
 #include "DumbHostObject.h"
+#include "QueryCancellation.h"
 #include "SmartHostObject.h"
+#include "StatementCache.h"
 #include "logs.h"
 #include "utils.h"
+#include <array>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
+#include <strings.h>
 #include <unordered_map>
 #include <variant>
 
@@ -23,6 +29,148 @@
 
 namespace opsqlite {
 
+/// Prepared statement caches of every open connection
+std::unordered_map<sqlite3 *, std::shared_ptr<StatementCache>> statement_caches;
+std::mutex statement_caches_mutex;
+
+std::shared_ptr<StatementCache> opsqlite_get_statement_cache(sqlite3 *db) {
+  std::lock_guard<std::mutex> lock(statement_caches_mutex);
+  auto it = statement_caches.find(db);
+  if (it == statement_caches.end()) {
+    return nullptr;
+  }
+  return it->second;
+}
+
+/// DDL and (de)attaching databases invalidate the cached statements
+bool is_schema_statement(const char *sql) {
+  while (isspace(static_cast<unsigned char>(*sql))) {
+    sql++;
+  }
+
+  for (const char *keyword : {"CREATE", "DROP", "ALTER", "ATTACH", "DETACH"}) {
+    if (sqlite3_strnicmp(sql, keyword, static_cast<int>(strlen(keyword))) ==
+        0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool is_blank(const char *sql) {
+  while (*sql != '\0') {
+    if (!isspace(static_cast<unsigned char>(*sql))) {
+      return false;
+    }
+    sql++;
+  }
+  return true;
+}
+
+#ifndef SQLITE_OMIT_PROGRESS_CALLBACK
+// Virtual machine instructions between two deadline checks
+static const int PROGRESS_HANDLER_OPS = 1000;
+
+/// Stops the query running on this thread once it is past its deadline.
+/// Cancelling also interrupts, this catches a cancel that came before the
+/// first step
+static int on_progress(void *) {
+  QueryCancellation *cancellation = CancellationScope::current;
+  return cancellation != nullptr && cancellation->is_expired();
+}
+#endif
+
+/// Prepares the next statement of a query. Queries made of a single statement
+/// are taken from the connection's statement cache, is_cacheable tells if the
+/// statement should be handed back with opsqlite_finish_statement
+int opsqlite_prepare_next(sqlite3 *db, StatementCache *cache,
+                          std::string const &query,
+                          const char **remaining_statement,
+                          sqlite3_stmt **statement, bool *is_cacheable) {
+  bool is_first = *remaining_statement == nullptr;
+  *is_cacheable = false;
+
+  if (is_first && cache != nullptr) {
+    *statement = cache->acquire(query);
+    if (*statement != nullptr) {
+      *remaining_statement = "";
+      *is_cacheable = true;
+      return SQLITE_OK;
+    }
+  }
+
+  const char *query_str = is_first ? query.c_str() : *remaining_statement;
+  int status = sqlite3_prepare_v3(
+      db, query_str, -1, cache != nullptr ? SQLITE_PREPARE_PERSISTENT : 0,
+      statement, remaining_statement);
+
+  *is_cacheable = status == SQLITE_OK && is_first && cache != nullptr &&
+                  *statement != nullptr && is_blank(*remaining_statement) &&
+                  !is_schema_statement(query_str);
+
+  return status;
+}
+
+/// Returns the statement to the cache or finalizes it. Failed statements are
+/// always finalized so broken statements do not stay cached
+void opsqlite_finish_statement(StatementCache *cache, std::string const &query,
+                               sqlite3_stmt *statement, bool is_cacheable,
+                               bool has_failed) {
+  if (cache != nullptr && !has_failed &&
+      is_schema_statement(sqlite3_sql(statement))) {
+    cache->clear();
+  }
+
+  if (is_cacheable && !has_failed) {
+    cache->release(query, statement);
+  } else {
+    sqlite3_finalize(statement);
+  }
+}
+
+void opsqlite_set_statement_cache_size(sqlite3 *db, size_t size) {
+  auto cache = opsqlite_get_statement_cache(db);
+  if (cache != nullptr) {
+    cache->set_capacity(size);
+  }
+}
+
+StatementCacheStats opsqlite_get_statement_cache_stats(sqlite3 *db) {
+  auto cache = opsqlite_get_statement_cache(db);
+  if (cache == nullptr) {
+    return {};
+  }
+  return cache->stats();
+}
+
+bool opsqlite_is_readonly(sqlite3 *db, std::string const &query) {
+  auto cache = opsqlite_get_statement_cache(db);
+  const char *remaining_statement = nullptr;
+  sqlite3_stmt *statement;
+  bool is_cacheable;
+
+  int status = opsqlite_prepare_next(db, cache.get(), query,
+                                     &remaining_statement, &statement,
+                                     &is_cacheable);
+
+  // Errors are left for the main connection to report
+  if (status != SQLITE_OK || statement == nullptr) {
+    return false;
+  }
+
+  bool is_readonly = sqlite3_stmt_readonly(statement) != 0 &&
+                     (remaining_statement == nullptr ||
+                      is_blank(remaining_statement));
+
+  // Goes back to the cache, so the execution that follows does not prepare
+  // the query again
+  opsqlite_finish_statement(cache.get(), query, statement, is_cacheable,
+                            false);
+
+  return is_readonly;
+}
+
 inline void opsqlite_bind_statement(sqlite3_stmt *statement,
                                     const std::vector<JSVariant> *values) {
   sqlite3_clear_bindings(statement);
@@ -81,18 +229,21 @@ std::string opsqlite_get_db_path(std::string const &db_name,
 sqlite3 *opsqlite_open(std::string const &name, std::string const &path,
                        std::string const &crsqlite_path,
                        std::string const &sqlite_vec_path,
-                       std::string const &encryption_key) {
+                       std::string const &encryption_key, bool read_only) {
 #else
 sqlite3 *opsqlite_open(std::string const &name, std::string const &path,
                        [[maybe_unused]] std::string const &crsqlite_path,
-                       [[maybe_unused]] std::string const &sqlite_vec_path) {
+                       [[maybe_unused]] std::string const &sqlite_vec_path,
+                       bool read_only) {
 #endif
   std::string final_path = opsqlite_get_db_path(name, path);
   char *errMsg;
   sqlite3 *db;
 
   int flags =
-      SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX;
+      read_only
+          ? SQLITE_OPEN_READONLY | SQLITE_OPEN_FULLMUTEX
+          : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX;
 
   int status = sqlite3_open_v2(final_path.c_str(), &db, flags, nullptr);
 
@@ -111,13 +262,16 @@ sqlite3 *opsqlite_open(std::string const &name, std::string const &path,
 #endif
 
 #ifdef OP_SQLITE_USE_CRSQLITE
-  const char *crsqliteEntryPoint = "sqlite3_crsqlite_init";
+  // cr-sqlite writes its own tables when loaded, readers go without it
+  if (!read_only) {
+    const char *crsqliteEntryPoint = "sqlite3_crsqlite_init";
 
-  sqlite3_load_extension(db, crsqlite_path.c_str(), crsqliteEntryPoint,
-                         &errMsg);
+    sqlite3_load_extension(db, crsqlite_path.c_str(), crsqliteEntryPoint,
+                           &errMsg);
 
-  if (errMsg != nullptr) {
-    throw std::runtime_error(errMsg);
+    if (errMsg != nullptr) {
+      throw std::runtime_error(errMsg);
+    }
   }
 #endif
 
@@ -133,14 +287,36 @@ sqlite3 *opsqlite_open(std::string const &name, std::string const &path,
 
   TOKENIZER_LIST
 
+#ifndef SQLITE_OMIT_PROGRESS_CALLBACK
+  sqlite3_progress_handler(db, PROGRESS_HANDLER_OPS, on_progress, nullptr);
+#endif
+
+  {
+    std::lock_guard<std::mutex> lock(statement_caches_mutex);
+    statement_caches[db] =
+        std::make_shared<StatementCache>(DEFAULT_STATEMENT_CACHE_SIZE);
+  }
+
   return db;
 }
 
 void opsqlite_close(sqlite3 *db) {
 #ifdef OP_SQLITE_USE_CRSQLITE
-  opsqlite_execute(db, "select crsql_finalize();", nullptr);
+  if (!sqlite3_db_readonly(db, "main")) {
+    opsqlite_execute(db, "select crsql_finalize();", nullptr);
+  }
 #endif
 
+  {
+    // Cached statements need to be finalized or the connection cannot close
+    std::lock_guard<std::mutex> lock(statement_caches_mutex);
+    auto it = statement_caches.find(db);
+    if (it != statement_caches.end()) {
+      it->second->clear();
+      statement_caches.erase(it);
+    }
+  }
+
   sqlite3_close_v2(db);
 }
 
@@ -234,7 +410,7 @@ BridgeResult opsqlite_execute_prepared_statement(
           // always copy the data
           memcpy(data, blob, blob_size);
           row.values.emplace_back(
-              ArrayBuffer{.data = std::shared_ptr<uint8_t>{data},
+              ArrayBuffer{.data = std::shared_ptr<uint8_t[]>{data},
                           .size = static_cast<size_t>(blob_size)});
           break;
         }
@@ -315,6 +491,116 @@ sqlite3_stmt *opsqlite_prepare_statement(sqlite3 *db,
   return statement;
 }
 
+static uint64_t column_bit(int index) {
+  return index < 63 ? 1ULL << index : OTHER_COLUMNS;
+}
+
+static int on_authorize_read(void *reads_ptr, int action, const char *table,
+                             const char *column, const char *database,
+                             [[maybe_unused]] const char *trigger) {
+  auto reads = reinterpret_cast<std::vector<std::array<std::string, 3>> *>(
+      reads_ptr);
+
+  // Reads of the schema tables are not invalidated by row changes
+  if (action == SQLITE_READ && strncmp(table, "sqlite_", 7) != 0) {
+    reads->push_back({database != nullptr ? database : "main", table,
+                      column != nullptr ? column : ""});
+  }
+
+  return SQLITE_OK;
+}
+
+std::vector<std::string> opsqlite_get_table_columns(sqlite3 *db,
+                                                    std::string const &schema,
+                                                    std::string const &table,
+                                                    bool *has_hidden) {
+  std::vector<std::string> names;
+  sqlite3_stmt *info;
+
+  sqlite3_prepare_v2(db, "SELECT name, hidden FROM pragma_table_xinfo(?, ?)",
+                     -1, &info, nullptr);
+  sqlite3_bind_text(info, 1, table.c_str(), -1, SQLITE_STATIC);
+  sqlite3_bind_text(info, 2, schema.c_str(), -1, SQLITE_STATIC);
+
+  while (sqlite3_step(info) == SQLITE_ROW) {
+    names.emplace_back(
+        reinterpret_cast<const char *>(sqlite3_column_text(info, 0)));
+    if (has_hidden != nullptr && sqlite3_column_int(info, 1) != 0) {
+      *has_hidden = true;
+    }
+  }
+
+  sqlite3_finalize(info);
+  return names;
+}
+
+sqlite3_stmt *
+opsqlite_prepare_tracking_reads(sqlite3 *db, std::string const &query,
+                                std::unordered_map<std::string, uint64_t> *reads) {
+  // Schema, table and column of every read
+  std::vector<std::array<std::string, 3>> columns;
+  sqlite3_stmt *statement = nullptr;
+  int status;
+
+  {
+    // Statements prepared by the workers in the meantime must not be tracked
+    sqlite3_mutex *mutex = sqlite3_db_mutex(db);
+    sqlite3_mutex_enter(mutex);
+    sqlite3_set_authorizer(db, on_authorize_read, &columns);
+    status = sqlite3_prepare_v2(db, query.c_str(), -1, &statement, nullptr);
+    sqlite3_set_authorizer(db, nullptr, nullptr);
+    sqlite3_mutex_leave(mutex);
+  }
+
+  if (status != SQLITE_OK) {
+    throw std::runtime_error("[op-sqlite] SQL prepare statement error: " +
+                             std::string(sqlite3_errmsg(db)));
+  }
+
+  // Column names of each table, in the order the update hooks use
+  std::unordered_map<std::string, std::vector<std::string>> table_columns;
+
+  for (const auto &read : columns) {
+    const std::string &table = read[1];
+    const std::string &column = read[2];
+    uint64_t &mask = (*reads)[table];
+
+    if (column.empty()) {
+      continue;
+    }
+
+    auto it = table_columns.find(table);
+    if (it == table_columns.end()) {
+      bool has_hidden = false;
+      auto names = opsqlite_get_table_columns(db, read[0], table, &has_hidden);
+      // Generated columns do not line up with the preupdate hook columns
+      if (has_hidden) {
+        names.clear();
+      }
+      it = table_columns.emplace(table, std::move(names)).first;
+    }
+
+    const auto &names = it->second;
+    if (names.empty()) {
+      mask = ALL_COLUMNS;
+      continue;
+    }
+
+    size_t index = 0;
+    while (index < names.size() &&
+           strcasecmp(names[index].c_str(), column.c_str()) != 0) {
+      index++;
+    }
+
+    // The rowid is read under its own name when the table has no INTEGER
+    // PRIMARY KEY
+    mask |= index < names.size() ? column_bit(static_cast<int>(index))
+                                 : OTHER_COLUMNS;
+  }
+
+  return statement;
+}
+
 BridgeResult opsqlite_execute(sqlite3 *db, std::string const &query,
                               const std::vector<JSVariant> *params) {
   sqlite3_stmt *statement;
@@ -324,16 +610,13 @@ BridgeResult opsqlite_execute(sqlite3 *db, std::string const &query,
   int status, current_column, column_count, column_type;
   std::string column_name, column_declared_type;
   std::vector<std::string> column_names;
-  std::vector<std::vector<JSVariant>> rows;
-  rows.reserve(20);
-  std::vector<JSVariant> row;
+  RowArena rows;
+  auto cache = opsqlite_get_statement_cache(db);
+  bool is_cacheable;
 
   do {
-    const char *query_str =
-        remainingStatement == nullptr ? query.c_str() : remainingStatement;
-
-    status =
-        sqlite3_prepare_v2(db, query_str, -1, &statement, &remainingStatement);
+    status = opsqlite_prepare_next(db, cache.get(), query, &remainingStatement,
+                                   &statement, &is_cacheable);
 
     if (status != SQLITE_OK) {
       errorMessage = sqlite3_errmsg(db);
@@ -352,7 +635,14 @@ BridgeResult opsqlite_execute(sqlite3 *db, std::string const &query,
     }
 
     column_count = sqlite3_column_count(statement);
-    column_names.reserve(column_count);
+    // The rows of a single arena share one shape, when several statements
+    // return rows the last result set is kept, same as executeColumnar
+    if (column_count > 0) {
+      column_names.clear();
+      column_names.reserve(column_count);
+      rows = RowArena(column_count);
+      rows.reserve_rows(20);
+    }
     bool is_consuming_rows = true;
     double double_value;
     const char *string_value;
@@ -369,8 +659,6 @@ BridgeResult opsqlite_execute(sqlite3 *db, std::string const &query,
       switch (status) {
       case SQLITE_ROW:
         current_column = 0;
-        row = std::vector<JSVariant>();
-        row.reserve(column_count);
 
         while (current_column < column_count) {
           column_type = sqlite3_column_type(statement, current_column);
@@ -381,7 +669,7 @@ BridgeResult opsqlite_execute(sqlite3 *db, std::string const &query,
             // intentional fallthrough
           case SQLITE_FLOAT: {
             double_value = sqlite3_column_double(statement, current_column);
-            row.emplace_back(double_value);
+            rows.push_number(double_value);
             break;
           }
 
@@ -390,32 +678,26 @@ BridgeResult opsqlite_execute(sqlite3 *db, std::string const &query,
                 sqlite3_column_text(statement, current_column));
             int len = sqlite3_column_bytes(statement, current_column);
             // Specify length too; in case string contains NULL in the middle
-            row.emplace_back(std::string(string_value, len));
+            rows.push_text(string_value, len);
             break;
           }
 
           case SQLITE_BLOB: {
             int blob_size = sqlite3_column_bytes(statement, current_column);
             const void *blob = sqlite3_column_blob(statement, current_column);
-            auto *data = new uint8_t[blob_size];
-            memcpy(data, blob, blob_size);
-            row.emplace_back(
-                ArrayBuffer{.data = std::shared_ptr<uint8_t>{data},
-                            .size = static_cast<size_t>(blob_size)});
+            rows.push_blob(blob, blob_size);
             break;
           }
 
           case SQLITE_NULL:
             // Intentionally left blank to switch to default case
           default:
-            row.emplace_back(nullptr);
+            rows.push_null();
             break;
           }
 
           current_column++;
         }
-
-        rows.emplace_back(std::move(row));
         break;
 
       case SQLITE_DONE:
@@ -428,7 +710,8 @@ BridgeResult opsqlite_execute(sqlite3 *db, std::string const &query,
       }
     }
 
-    sqlite3_finalize(statement);
+    opsqlite_finish_statement(cache.get(), query, statement, is_cacheable,
+                              has_failed);
   } while (remainingStatement != nullptr &&
            strcmp(remainingStatement, "") != 0 && !has_failed);
 
@@ -460,12 +743,13 @@ BridgeResult opsqlite_execute_host_objects(
 
   int result = SQLITE_OK;
 
-  do {
-    const char *queryStr =
-        remainingStatement == nullptr ? query.c_str() : remainingStatement;
+  auto cache = opsqlite_get_statement_cache(db);
+  bool is_cacheable;
 
+  do {
     int statementStatus =
-        sqlite3_prepare_v2(db, queryStr, -1, &statement, &remainingStatement);
+        opsqlite_prepare_next(db, cache.get(), query, &remainingStatement,
+                              &statement, &is_cacheable);
 
     if (statementStatus != SQLITE_OK) {
       const char *message = sqlite3_errmsg(db);
@@ -539,7 +823,7 @@ BridgeResult opsqlite_execute_host_objects(
             // always copy the data
             memcpy(data, blob, blob_size);
             row.values.emplace_back(
-                ArrayBuffer{.data = std::shared_ptr<uint8_t>{data},
+                ArrayBuffer{.data = std::shared_ptr<uint8_t[]>{data},
                             .size = static_cast<size_t>(blob_size)});
             break;
           }
@@ -586,7 +870,8 @@ BridgeResult opsqlite_execute_host_objects(
       }
     }
 
-    sqlite3_finalize(statement);
+    opsqlite_finish_statement(cache.get(), query, statement, is_cacheable,
+                              isFailed);
   } while (remainingStatement != nullptr &&
            strcmp(remainingStatement, "") != 0 && !isFailed);
 
@@ -618,12 +903,13 @@ opsqlite_execute_raw(sqlite3 *db, std::string const &query,
 
   int step = SQLITE_OK;
 
-  do {
-    const char *queryStr =
-        remainingStatement == nullptr ? query.c_str() : remainingStatement;
+  auto cache = opsqlite_get_statement_cache(db);
+  bool is_cacheable;
 
+  do {
     int statementStatus =
-        sqlite3_prepare_v2(db, queryStr, -1, &statement, &remainingStatement);
+        opsqlite_prepare_next(db, cache.get(), query, &remainingStatement,
+                              &statement, &is_cacheable);
 
     if (statementStatus != SQLITE_OK) {
       const char *message = sqlite3_errmsg(db);
@@ -687,7 +973,7 @@ opsqlite_execute_raw(sqlite3 *db, std::string const &query,
             auto *data = new uint8_t[blob_size];
             memcpy(data, blob, blob_size);
             row.emplace_back(
-                ArrayBuffer{.data = std::shared_ptr<uint8_t>{data},
+                ArrayBuffer{.data = std::shared_ptr<uint8_t[]>{data},
                             .size = static_cast<size_t>(blob_size)});
             break;
           }
@@ -717,7 +1003,8 @@ opsqlite_execute_raw(sqlite3 *db, std::string const &query,
       }
     }
 
-    sqlite3_finalize(statement);
+    opsqlite_finish_statement(cache.get(), query, statement, is_cacheable,
+                              isFailed);
   } while (remainingStatement != nullptr &&
            strcmp(remainingStatement, "") != 0 && !isFailed);
 
@@ -734,16 +1021,334 @@ opsqlite_execute_raw(sqlite3 *db, std::string const &query,
           .insertId = static_cast<double>(latestInsertRowId)};
 }
 
-std::string operation_to_string(int operation_type) {
+/// Steps the statement until count rows have been read or there are no more
+/// rows, returns true when the statement is exhausted
+bool opsqlite_step_statement(sqlite3 *db, sqlite3_stmt *statement,
+                             size_t count, RowArena *rows) {
+  int column_count = sqlite3_column_count(statement);
+  rows->set_column_count(column_count);
+
+  for (size_t read = 0; read < count; read++) {
+    int status = sqlite3_step(statement);
+
+    if (status == SQLITE_DONE) {
+      return true;
+    }
+
+    if (status != SQLITE_ROW) {
+      throw std::runtime_error("[op-sqlite] statement execution error: " +
+                               std::string(sqlite3_errmsg(db)));
+    }
+
+    for (int i = 0; i < column_count; i++) {
+      switch (sqlite3_column_type(statement, i)) {
+      case SQLITE_INTEGER:
+      case SQLITE_FLOAT:
+        rows->push_number(sqlite3_column_double(statement, i));
+        break;
+
+      case SQLITE_TEXT: {
+        const char *column_value =
+            reinterpret_cast<const char *>(sqlite3_column_text(statement, i));
+        int byteLen = sqlite3_column_bytes(statement, i);
+        // Specify length too; in case string contains NULL in the middle
+        rows->push_text(column_value, byteLen);
+        break;
+      }
+
+      case SQLITE_BLOB: {
+        int blob_size = sqlite3_column_bytes(statement, i);
+        const void *blob = sqlite3_column_blob(statement, i);
+        rows->push_blob(blob, blob_size);
+        break;
+      }
+
+      case SQLITE_NULL:
+        // intentional fallthrough
+      default:
+        rows->push_null();
+        break;
+      }
+    }
+  }
+
+  return false;
+}
+
+BridgeResult opsqlite_run_statement(sqlite3 *db, sqlite3_stmt *statement,
+                                    const std::vector<JSVariant> *params) {
+  sqlite3_reset(statement);
+  if (params != nullptr) {
+    opsqlite_bind_statement(statement, params);
+  }
+
+  BridgeResult result{.affectedRows = 0, .insertId = 0};
+  int column_count = sqlite3_column_count(statement);
+  result.column_names.reserve(column_count);
+  for (int i = 0; i < column_count; i++) {
+    result.column_names.emplace_back(sqlite3_column_name(statement, i));
+  }
+
+  try {
+    opsqlite_step_statement(db, statement, SIZE_MAX, &result.rows);
+  } catch (...) {
+    sqlite3_reset(statement);
+    throw;
+  }
+
+  // A statement left un-reset keeps its read transaction open
+  sqlite3_reset(statement);
+
+  result.affectedRows = sqlite3_changes(db);
+  result.insertId = static_cast<double>(sqlite3_last_insert_rowid(db));
+  return result;
+}
+
+BatchResult
+opsqlite_run_statement_many(sqlite3 *db, sqlite3_stmt *statement,
+                            const std::vector<std::vector<JSVariant>> &params) {
+  int affected_rows = 0;
+
+  // A savepoint works inside and outside of an open transaction
+  opsqlite_execute(db, "SAVEPOINT op_sqlite_run_many", nullptr);
+
+  for (const auto &values : params) {
+    sqlite3_reset(statement);
+    opsqlite_bind_statement(statement, &values);
+
+    // Rows are discarded, same as in a batch
+    int status;
+    do {
+      status = sqlite3_step(statement);
+    } while (status == SQLITE_ROW);
+
+    if (status != SQLITE_DONE) {
+      std::string message = sqlite3_errmsg(db);
+      sqlite3_reset(statement);
+      // Some errors already rolled back the whole transaction
+      if (!sqlite3_get_autocommit(db)) {
+        opsqlite_execute(db, "ROLLBACK TO op_sqlite_run_many", nullptr);
+        opsqlite_execute(db, "RELEASE op_sqlite_run_many", nullptr);
+      }
+      throw std::runtime_error("[op-sqlite] statement execution error: " +
+                               message);
+    }
+
+    affected_rows += sqlite3_changes(db);
+  }
+
+  sqlite3_reset(statement);
+  opsqlite_execute(db, "RELEASE op_sqlite_run_many", nullptr);
+
+  return BatchResult{
+      .affectedRows = affected_rows,
+      .commands = static_cast<int>(params.size()),
+  };
+}
+
+/// Once all the rows are read picks the most compact representation for the
+/// column and builds its NULL bitmap
+void finish_columnar_column(ColumnarColumn &column) {
+  // Integers above this cannot be represented by a JS number
+  const int64_t max_safe_integer = 9007199254740991;
+  const int numeric_mask = (1 << SQLITE_INTEGER) | (1 << SQLITE_FLOAT);
+  size_t row_count = column.types.size();
+  int type_mask = 0;
+  bool has_nulls = false;
+  bool has_unsafe_integers = false;
+
+  for (size_t i = 0; i < row_count; i++) {
+    int type = column.types[i];
+    if (type == SQLITE_NULL) {
+      has_nulls = true;
+      continue;
+    }
+
+    type_mask |= 1 << type;
+    if (type == SQLITE_INTEGER && (column.numbers[i] > max_safe_integer ||
+                                   column.numbers[i] < -max_safe_integer)) {
+      has_unsafe_integers = true;
+    }
+  }
+
+  if (has_nulls) {
+    column.nulls.assign((row_count + 7) / 8, 0);
+    for (size_t i = 0; i < row_count; i++) {
+      if (column.types[i] == SQLITE_NULL) {
+        column.nulls[i >> 3] |= 1 << (i & 7);
+      }
+    }
+  }
+
+  if (type_mask == 0) {
+    column.kind = COLUMNAR_NULL;
+  } else if ((type_mask & ~numeric_mask) == 0) {
+    if (type_mask == (1 << SQLITE_INTEGER) && has_unsafe_integers) {
+      column.kind = COLUMNAR_BIGINT;
+    } else {
+      column.kind = COLUMNAR_NUMBER;
+      for (size_t i = 0; i < row_count; i++) {
+        if (column.types[i] == SQLITE_INTEGER) {
+          auto value = static_cast<double>(column.numbers[i]);
+          memcpy(&column.numbers[i], &value, sizeof(double));
+        }
+      }
+    }
+  } else if (type_mask == (1 << SQLITE_TEXT)) {
+    column.kind = COLUMNAR_TEXT;
+  } else if (type_mask == (1 << SQLITE_BLOB)) {
+    column.kind = COLUMNAR_BLOB;
+  } else {
+    column.kind = COLUMNAR_MIXED;
+  }
+
+  // Drop the buffers the chosen representation does not use
+  if (column.kind != COLUMNAR_MIXED) {
+    std::vector<uint8_t>().swap(column.types);
+  }
+  if (column.kind == COLUMNAR_TEXT || column.kind == COLUMNAR_BLOB ||
+      column.kind == COLUMNAR_NULL) {
+    std::vector<int64_t>().swap(column.numbers);
+  }
+  if (column.kind == COLUMNAR_NUMBER || column.kind == COLUMNAR_BIGINT ||
+      column.kind == COLUMNAR_NULL) {
+    std::vector<uint8_t>().swap(column.bytes);
+    std::vector<uint32_t>().swap(column.offsets);
+  }
+}
+
+/// Executes returning the data column by column in contiguous buffers, so it
+/// can be handed to JS as a handful of typed arrays instead of one value per
+/// cell. When the query contains several statements only the last result set
+/// is kept
+BridgeResult opsqlite_execute_columnar(sqlite3 *db, std::string const &query,
+                                       const std::vector<JSVariant> *params,
+                                       std::vector<ColumnarColumn> *columns,
+                                       size_t *row_count) {
+  sqlite3_stmt *statement;
+  const char *remaining_statement = nullptr;
+  auto cache = opsqlite_get_statement_cache(db);
+  bool is_cacheable;
+  bool has_failed = false;
+  int status;
+
+  *row_count = 0;
+
+  do {
+    status = opsqlite_prepare_next(db, cache.get(), query,
+                                   &remaining_statement, &statement,
+                                   &is_cacheable);
+
+    if (status != SQLITE_OK) {
+      throw std::runtime_error("[op-sqlite] sqlite query error: " +
+                               std::string(sqlite3_errmsg(db)));
+    }
+
+    // The statement did not fail to parse but there is nothing to do, just
+    // skip to the end
+    if (statement == nullptr) {
+      continue;
+    }
+
+    if (params != nullptr && !params->empty()) {
+      opsqlite_bind_statement(statement, params);
+    }
+
+    int column_count = sqlite3_column_count(statement);
+
+    if (column_count > 0) {
+      columns->clear();
+      columns->resize(column_count);
+      *row_count = 0;
+
+      for (int i = 0; i < column_count; i++) {
+        (*columns)[i].name = sqlite3_column_name(statement, i);
+        (*columns)[i].offsets.push_back(0);
+      }
+    }
+
+    while (true) {
+      status = sqlite3_step(statement);
+
+      if (status != SQLITE_ROW) {
+        has_failed = status != SQLITE_DONE;
+        break;
+      }
+
+      for (int i = 0; i < column_count; i++) {
+        auto &column = (*columns)[i];
+        int type = sqlite3_column_type(statement, i);
+        int64_t number = 0;
+
+        switch (type) {
+        case SQLITE_INTEGER:
+          number = sqlite3_column_int64(statement, i);
+          break;
+
+        case SQLITE_FLOAT: {
+          double value = sqlite3_column_double(statement, i);
+          memcpy(&number, &value, sizeof(double));
+          break;
+        }
+
+        case SQLITE_TEXT:
+        case SQLITE_BLOB: {
+          // Text needs to be fetched before asking for the size
+          auto data = type == SQLITE_TEXT
+                          ? static_cast<const void *>(
+                                sqlite3_column_text(statement, i))
+                          : sqlite3_column_blob(statement, i);
+          int size = sqlite3_column_bytes(statement, i);
+          auto bytes = static_cast<const uint8_t *>(data);
+          column.bytes.insert(column.bytes.end(), bytes, bytes + size);
+          break;
+        }
+
+        default:
+          type = SQLITE_NULL;
+          break;
+        }
+
+        column.types.push_back(static_cast<uint8_t>(type));
+        column.numbers.push_back(number);
+        column.offsets.push_back(static_cast<uint32_t>(column.bytes.size()));
+      }
+
+      (*row_count)++;
+    }
+
+    opsqlite_finish_statement(cache.get(), query, statement, is_cacheable,
+                              has_failed);
+  } while (remaining_statement != nullptr &&
+           strcmp(remaining_statement, "") != 0 && !has_failed);
+
+  if (has_failed) {
+    const char *message = sqlite3_errmsg(db);
+    throw std::runtime_error("[op-sqlite] statement execution error: " +
+                             std::string(message));
+  }
+
+  for (auto &column : *columns) {
+    finish_columnar_column(column);
+  }
+
+  int changedRowCount = sqlite3_changes(db);
+  long long latestInsertRowId = sqlite3_last_insert_rowid(db);
+
+  return {.affectedRows = changedRowCount,
+          .insertId = static_cast<double>(latestInsertRowId)};
+}
+
+UpdateOperation to_update_operation(int operation_type) {
   switch (operation_type) {
   case SQLITE_INSERT:
-    return "INSERT";
+    return UPDATE_OPERATION_INSERT;
 
   case SQLITE_DELETE:
-    return "DELETE";
+    return UPDATE_OPERATION_DELETE;
 
   case SQLITE_UPDATE:
-    return "UPDATE";
+    return UPDATE_OPERATION_UPDATE;
 
   default:
     throw std::runtime_error("Unknown SQLite operation on hook");
@@ -754,10 +1359,64 @@ void update_callback(void *db_host_object_ptr, int operation_type,
                      [[maybe_unused]] char const *database, char const *table,
                      sqlite3_int64 row_id) {
   auto db_host_object = reinterpret_cast<DBHostObject *>(db_host_object_ptr);
-  db_host_object->on_update(std::string(table),
-                            operation_to_string(operation_type), row_id);
+  db_host_object->on_update(table, to_update_operation(operation_type),
+                            row_id);
+}
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+static bool is_same_value(sqlite3_value *a, sqlite3_value *b) {
+  int type = sqlite3_value_type(a);
+  if (type != sqlite3_value_type(b)) {
+    return false;
+  }
+
+  switch (type) {
+  case SQLITE_NULL:
+    return true;
+  case SQLITE_INTEGER:
+    return sqlite3_value_int64(a) == sqlite3_value_int64(b);
+  case SQLITE_FLOAT:
+    return sqlite3_value_double(a) == sqlite3_value_double(b);
+  default: {
+    int size = sqlite3_value_bytes(a);
+    return size == sqlite3_value_bytes(b) &&
+           memcmp(sqlite3_value_blob(a), sqlite3_value_blob(b), size) == 0;
+  }
+  }
 }
 
+/// Runs right before the update hook of the same row. Feeds the change data
+/// capture and tells which columns an UPDATE really changed
+void preupdate_callback(void *db_host_object_ptr, sqlite3 *db,
+                        int operation_type,
+                        [[maybe_unused]] char const *database,
+                        char const *table, sqlite3_int64 old_row_id,
+                        sqlite3_int64 new_row_id) {
+  auto db_host_object = reinterpret_cast<DBHostObject *>(db_host_object_ptr);
+  db_host_object->on_change(db, operation_type, table, old_row_id, new_row_id);
+
+  if (operation_type != SQLITE_UPDATE) {
+    return;
+  }
+
+  uint64_t changed_columns = old_row_id != new_row_id ? OTHER_COLUMNS : 0;
+  int column_count = sqlite3_preupdate_count(db);
+
+  for (int i = 0; i < column_count; i++) {
+    sqlite3_value *old_value;
+    sqlite3_value *new_value;
+    sqlite3_preupdate_old(db, i, &old_value);
+    sqlite3_preupdate_new(db, i, &new_value);
+
+    if (!is_same_value(old_value, new_value)) {
+      changed_columns |= column_bit(i);
+    }
+  }
+
+  db_host_object->on_update_columns(changed_columns);
+}
+#endif
+
 void opsqlite_register_update_hook(sqlite3 *db, void *db_host_object) {
   sqlite3_update_hook(db, &update_callback, (void *)db_host_object);
 }
@@ -766,6 +1425,122 @@ void opsqlite_deregister_update_hook(sqlite3 *db) {
   sqlite3_update_hook(db, nullptr, nullptr);
 }
 
+void opsqlite_register_preupdate_hook(sqlite3 *db, void *db_host_object) {
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+  sqlite3_preupdate_hook(db, &preupdate_callback, (void *)db_host_object);
+#endif
+}
+
+void opsqlite_deregister_preupdate_hook(sqlite3 *db) {
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+  sqlite3_preupdate_hook(db, nullptr, nullptr);
+#endif
+}
+
+/// Skips the whitespace and comments in front of a statement
+static const char *skip_blank(const char *sql) {
+  while (true) {
+    while (isspace(static_cast<unsigned char>(*sql))) {
+      sql++;
+    }
+
+    if (sql[0] == '-' && sql[1] == '-') {
+      sql = strchr(sql, '\n');
+      if (sql == nullptr) {
+        return "";
+      }
+    } else if (sql[0] == '/' && sql[1] == '*') {
+      sql = strstr(sql + 2, "*/");
+      if (sql == nullptr) {
+        return "";
+      }
+      sql += 2;
+    } else {
+      return sql;
+    }
+  }
+}
+
+/// Moves sql past the keyword and the blanks after it
+static bool take_keyword(const char *&sql, const char *keyword) {
+  size_t length = strlen(keyword);
+  if (strncasecmp(sql, keyword, length) != 0 ||
+      isalnum(static_cast<unsigned char>(sql[length])) || sql[length] == '_') {
+    return false;
+  }
+
+  sql = skip_blank(sql + length);
+  return true;
+}
+
+/// Savepoint name at the start of sql, without its quotes
+static std::string take_name(const char *sql) {
+  char quote = *sql == '[' ? ']' : *sql;
+  if (quote == '"' || quote == '\'' || quote == '`' || quote == ']') {
+    const char *end = strchr(sql + 1, quote);
+    return end == nullptr ? std::string(sql + 1)
+                          : std::string(sql + 1, end - sql - 1);
+  }
+
+  const char *end = sql;
+  while (*end != '\0' && *end != ';' &&
+         !isspace(static_cast<unsigned char>(*end))) {
+    end++;
+  }
+  return std::string(sql, end - sql);
+}
+
+/// Runs when a statement starts. Trigger programs are reported as a comment
+/// and skipped with it
+static void trace_savepoint(DBHostObject *db_host_object, const char *sql) {
+  sql = skip_blank(sql);
+  SavepointOperation operation;
+
+  if (take_keyword(sql, "SAVEPOINT")) {
+    operation = SAVEPOINT_OPERATION_BEGIN;
+  } else if (take_keyword(sql, "RELEASE")) {
+    take_keyword(sql, "SAVEPOINT");
+    operation = SAVEPOINT_OPERATION_RELEASE;
+  } else if (take_keyword(sql, "ROLLBACK")) {
+    take_keyword(sql, "TRANSACTION");
+    // A plain ROLLBACK ends the transaction, the rollback hook sees it
+    if (!take_keyword(sql, "TO")) {
+      return;
+    }
+    take_keyword(sql, "SAVEPOINT");
+    operation = SAVEPOINT_OPERATION_ROLLBACK_TO;
+  } else {
+    return;
+  }
+
+  db_host_object->on_savepoint(operation, take_name(sql));
+}
+
+static int statement_trace_callback(unsigned int type,
+                                    void *db_host_object_ptr, void *statement,
+                                    void *sql) {
+  auto db_host_object = reinterpret_cast<DBHostObject *>(db_host_object_ptr);
+
+  if (type == SQLITE_TRACE_STMT) {
+    trace_savepoint(db_host_object, static_cast<const char *>(sql));
+  } else if (type == SQLITE_TRACE_PROFILE) {
+    // The statement is done, a failed BEGIN leaves the connection in
+    // autocommit and a COMMIT in the same string puts it back
+    sqlite3 *db = sqlite3_db_handle(static_cast<sqlite3_stmt *>(statement));
+    db_host_object->on_transaction_state(sqlite3_get_autocommit(db) == 0);
+  }
+
+  return 0;
+}
+
+void opsqlite_set_statement_trace(sqlite3 *db, void *db_host_object_ptr,
+                                  bool savepoints, bool transactions) {
+  unsigned int mask = (savepoints ? SQLITE_TRACE_STMT : 0) |
+                      (transactions ? SQLITE_TRACE_PROFILE : 0);
+  sqlite3_trace_v2(db, mask, mask != 0 ? &statement_trace_callback : nullptr,
+                   mask != 0 ? db_host_object_ptr : nullptr);
+}
+
 int commit_callback(void *db_host_object_ptr) {
   auto db_host_object = reinterpret_cast<DBHostObject *>(db_host_object_ptr);
   db_host_object->on_commit();
@@ -821,6 +1596,15 @@ void opsqlite_load_extension(sqlite3 *db, std::string &path,
 #endif
 }
 
+/// A statement prepared once and re-used for every parameter set of a batch
+struct BatchStatement {
+  sqlite3_stmt *statement;
+  bool is_cacheable;
+  // Queries with several statements cannot be re-used and are executed
+  // normally
+  bool is_multi_statement;
+};
+
 BatchResult opsqlite_execute_batch(sqlite3 *db,
                                    std::vector<BatchArguments> *commands) {
   size_t commandCount = commands->size();
@@ -828,20 +1612,96 @@ BatchResult opsqlite_execute_batch(sqlite3 *db,
     throw std::runtime_error("No SQL commands provided");
   }
 
+  auto cache = opsqlite_get_statement_cache(db);
+  std::unordered_map<std::string, BatchStatement> statements;
+
+  auto finish_statements = [&](bool has_failed) {
+    for (auto &pair : statements) {
+      if (pair.second.statement != nullptr) {
+        opsqlite_finish_statement(cache.get(), pair.first,
+                                  pair.second.statement,
+                                  pair.second.is_cacheable, has_failed);
+      }
+    }
+    statements.clear();
+  };
+
   int affectedRows = 0;
   opsqlite_execute(db, "BEGIN EXCLUSIVE TRANSACTION", nullptr);
   for (int i = 0; i < commandCount; i++) {
     const auto &command = commands->at(i);
-    // We do not provide a datastructure to receive query data because we
-    // don't need/want to handle this results in a batch execution
+
     try {
-      auto result = opsqlite_execute(db, command.sql, command.params.get());
-      affectedRows += result.affectedRows;
+      auto it = statements.find(command.sql);
+
+      if (it == statements.end()) {
+        BatchStatement batch_statement = {nullptr, false, false};
+        const char *remaining_statement = nullptr;
+        int status = opsqlite_prepare_next(
+            db, cache.get(), command.sql, &remaining_statement,
+            &batch_statement.statement, &batch_statement.is_cacheable);
+
+        if (status != SQLITE_OK) {
+          throw std::runtime_error("[op-sqlite] sqlite query error: " +
+                                   std::string(sqlite3_errmsg(db)));
+        }
+
+        if (batch_statement.statement != nullptr &&
+            !is_blank(remaining_statement)) {
+          sqlite3_finalize(batch_statement.statement);
+          batch_statement.statement = nullptr;
+          batch_statement.is_multi_statement = true;
+        }
+
+        it = statements.emplace(command.sql, batch_statement).first;
+      }
+
+      const auto &batch_statement = it->second;
+
+      if (batch_statement.is_multi_statement) {
+        // We do not provide a datastructure to receive query data because we
+        // don't need/want to handle this results in a batch execution
+        auto result = opsqlite_execute(db, command.sql, command.params.get());
+        affectedRows += result.affectedRows;
+        continue;
+      }
+
+      // Nothing to execute, e.g. the query only contains a comment
+      if (batch_statement.statement == nullptr) {
+        continue;
+      }
+
+      sqlite3_stmt *statement = batch_statement.statement;
+
+      if (command.params != nullptr) {
+        opsqlite_bind_statement(statement, command.params.get());
+      } else {
+        sqlite3_clear_bindings(statement);
+      }
+
+      // Rows returned by batch commands are discarded, no need to read them
+      int status;
+      do {
+        status = sqlite3_step(statement);
+      } while (status == SQLITE_ROW);
+
+      if (status != SQLITE_DONE) {
+        std::string message = sqlite3_errmsg(db);
+        sqlite3_reset(statement);
+        throw std::runtime_error("[op-sqlite] statement execution error: " +
+                                 message);
+      }
+
+      sqlite3_reset(statement);
+      affectedRows += sqlite3_changes(db);
     } catch (std::exception &exc) {
+      finish_statements(true);
       opsqlite_execute(db, "ROLLBACK", nullptr);
-      throw exc;
+      throw std::runtime_error(exc.what());
     }
   }
+
+  finish_statements(false);
   opsqlite_execute(db, "COMMIT", nullptr);
   return BatchResult{
       .affectedRows = affectedRows,
@@ -849,4 +1709,148 @@ BatchResult opsqlite_execute_batch(sqlite3 *db,
   };
 }
 
+JSVariant opsqlite_value_to_variant(sqlite3_value *value) {
+  switch (value == nullptr ? SQLITE_NULL : sqlite3_value_type(value)) {
+  case SQLITE_INTEGER:
+  case SQLITE_FLOAT:
+    return sqlite3_value_double(value);
+
+  case SQLITE_TEXT:
+    return std::string(reinterpret_cast<const char *>(sqlite3_value_text(value)),
+                       sqlite3_value_bytes(value));
+
+  case SQLITE_BLOB: {
+    int size = sqlite3_value_bytes(value);
+    auto *data = new uint8_t[size];
+    memcpy(data, sqlite3_value_blob(value), size);
+    return ArrayBuffer{.data = std::shared_ptr<uint8_t[]>{data},
+                       .size = static_cast<size_t>(size)};
+  }
+
+  default:
+    return nullptr;
+  }
+}
+
+#ifdef SQLITE_ENABLE_SESSION
+sqlite3_session *opsqlite_create_session(sqlite3 *db,
+                                         std::vector<std::string> const &tables) {
+  sqlite3_session *session;
+  int status = sqlite3session_create(db, "main", &session);
+  if (status != SQLITE_OK) {
+    throw std::runtime_error("[op-sqlite] could not create session: " +
+                             std::string(sqlite3_errmsg(db)));
+  }
+
+  try {
+    if (tables.empty()) {
+      opsqlite_session_attach(session, nullptr);
+    }
+    for (const auto &table : tables) {
+      opsqlite_session_attach(session, table.c_str());
+    }
+  } catch (...) {
+    sqlite3session_delete(session);
+    throw;
+  }
+
+  return session;
+}
+
+void opsqlite_session_attach(sqlite3_session *session, char const *table) {
+  int status = sqlite3session_attach(session, table);
+  if (status != SQLITE_OK) {
+    throw std::runtime_error(
+        "[op-sqlite] could not attach " +
+        std::string(table == nullptr ? "all tables" : table) +
+        " to session, SQLite code: " + std::to_string(status));
+  }
+}
+
+ArrayBuffer opsqlite_session_changeset(sqlite3_session *session,
+                                       bool is_patchset) {
+  int size = 0;
+  void *changeset = nullptr;
+  int status = is_patchset
+                   ? sqlite3session_patchset(session, &size, &changeset)
+                   : sqlite3session_changeset(session, &size, &changeset);
+
+  if (status != SQLITE_OK) {
+    sqlite3_free(changeset);
+    throw std::runtime_error(
+        "[op-sqlite] could not generate changeset, SQLite code: " +
+        std::to_string(status));
+  }
+
+  // Copied out of SQLite's allocator so the ArrayBuffer can own it
+  auto *data = new uint8_t[size];
+  memcpy(data, changeset, size);
+  sqlite3_free(changeset);
+
+  return ArrayBuffer{.data = std::shared_ptr<uint8_t[]>{data},
+                     .size = static_cast<size_t>(size)};
+}
+
+ChangesetConflict opsqlite_read_conflict(int conflict_type,
+                                         sqlite3_changeset_iter *iterator) {
+  ChangesetConflict conflict{.type = conflict_type};
+  if (conflict_type == SQLITE_CHANGESET_FOREIGN_KEY) {
+    return conflict;
+  }
+
+  char const *table;
+  int column_count;
+  int is_indirect;
+  sqlite3changeset_op(iterator, &table, &column_count, &conflict.operation,
+                      &is_indirect);
+  conflict.table = table;
+
+  // Each getter only works for some operations and conflict types, and
+  // leaves the value null when the changeset does not have it
+  auto read = [&](auto getter, std::vector<JSVariant> &values) {
+    values.reserve(column_count);
+    for (int i = 0; i < column_count; i++) {
+      sqlite3_value *value = nullptr;
+      getter(iterator, i, &value);
+      values.push_back(opsqlite_value_to_variant(value));
+    }
+  };
+
+  if (conflict.operation != SQLITE_INSERT) {
+    read(sqlite3changeset_old, conflict.old_values);
+  }
+  if (conflict.operation != SQLITE_DELETE) {
+    read(sqlite3changeset_new, conflict.new_values);
+  }
+  if (conflict_type == SQLITE_CHANGESET_DATA ||
+      conflict_type == SQLITE_CHANGESET_CONFLICT) {
+    read(sqlite3changeset_conflict, conflict.conflicting_values);
+  }
+
+  return conflict;
+}
+
+static int on_changeset_conflict(void *context, int conflict_type,
+                                 sqlite3_changeset_iter *iterator) {
+  auto on_conflict = static_cast<ConflictHandler *>(context);
+  return (*on_conflict)(conflict_type, iterator);
+}
+
+void opsqlite_apply_changeset(sqlite3 *db, ArrayBuffer const &changeset,
+                              ConflictHandler const &on_conflict) {
+  int status = sqlite3changeset_apply(
+      db, static_cast<int>(changeset.size), changeset.data.get(), nullptr,
+      on_changeset_conflict, const_cast<ConflictHandler *>(&on_conflict));
+
+  // Aborting rolls back everything the changeset applied so far
+  if (status != SQLITE_OK) {
+    throw std::runtime_error(
+        status == SQLITE_ABORT
+            ? "[op-sqlite] changeset aborted on conflict"
+            : "[op-sqlite] could not apply changeset: " +
+                  std::string(sqlite3_errmsg(db)));
+  }
+}
+#endif
+
 } // namespace opsqlite
@@ -2,9 +2,12 @@
 
 #include "DumbHostObject.h"
 #include "SmartHostObject.h"
+#include "StatementCache.h"
 #include "types.h"
 #include "utils.h"
+#include <functional>
 #include <sqlite3.h>
+#include <unordered_map>
 #include <vector>
 
 namespace opsqlite {
@@ -25,11 +28,13 @@ std::string opsqlite_get_db_path(std::string const &db_name,
 sqlite3 *opsqlite_open(std::string const &dbName, std::string const &path,
                            std::string const &crsqlite_path,
                            std::string const &sqlite_vec_path,
-                           std::string const &encryption_key);
+                           std::string const &encryption_key,
+                           bool read_only = false);
 #else
 sqlite3 *opsqlite_open(std::string const &name, std::string const &path,
                        [[maybe_unused]] std::string const &crsqlite_path,
-                       std::string const &sqlite_vec_path);
+                       std::string const &sqlite_vec_path,
+                       bool read_only = false);
 #endif
 
 void opsqlite_close(sqlite3 *db);
@@ -60,8 +65,24 @@ BridgeResult opsqlite_execute_raw(sqlite3 *db, std::string const &query,
                                   const std::vector<JSVariant> *params,
                                   std::vector<std::vector<JSVariant>> *results);
 
+BridgeResult opsqlite_execute_columnar(sqlite3 *db, std::string const &query,
+                                       const std::vector<JSVariant> *params,
+                                       std::vector<ColumnarColumn> *columns,
+                                       size_t *row_count);
+
 void opsqlite_register_update_hook(sqlite3 *db, void *db_host_object_ptr);
 void opsqlite_deregister_update_hook(sqlite3 *db);
+/// A connection has a single preupdate hook and sessions install their own
+/// on it, only register this one while no session is open
+void opsqlite_register_preupdate_hook(sqlite3 *db, void *db_host_object_ptr);
+void opsqlite_deregister_preupdate_hook(sqlite3 *db);
+/// Follows the statements run on the connection, whichever function runs
+/// them. With savepoints the SAVEPOINT, RELEASE and ROLLBACK TO statements are
+/// reported, with transactions whether a transaction is open once a statement
+/// is done. A connection has a single trace, the trace is removed when both
+/// are off
+void opsqlite_set_statement_trace(sqlite3 *db, void *db_host_object_ptr,
+                                  bool savepoints, bool transactions);
 void opsqlite_register_commit_hook(sqlite3 *db, void *db_host_object_ptr);
 void opsqlite_deregister_commit_hook(sqlite3 *db);
 void opsqlite_register_rollback_hook(sqlite3 *db, void *db_host_object_ptr);
@@ -69,6 +90,25 @@ void opsqlite_deregister_rollback_hook(sqlite3 *db);
 
 sqlite3_stmt *opsqlite_prepare_statement(sqlite3 *db, std::string const &query);
 
+/// Bit i of a column mask stands for column i of a table. Columns past the
+/// 63rd and changes of the rowid share the last bit
+static const uint64_t ALL_COLUMNS = ~0ULL;
+static const uint64_t OTHER_COLUMNS = 1ULL << 63;
+
+/// Column names of a table in the order of its records, has_hidden is set
+/// when some of them are generated. Empty if the table does not exist
+std::vector<std::string> opsqlite_get_table_columns(sqlite3 *db,
+                                                    std::string const &schema,
+                                                    std::string const &table,
+                                                    bool *has_hidden = nullptr);
+
+/// Prepares a statement and records, through the authorizer, every table it
+/// reads with the mask of the columns read. Tables read without reading any
+/// column, e.g. SELECT count(*), get an empty mask
+sqlite3_stmt *
+opsqlite_prepare_tracking_reads(sqlite3 *db, std::string const &query,
+                                std::unordered_map<std::string, uint64_t> *reads);
+
 void opsqlite_bind_statement(sqlite3_stmt *statement,
                              const std::vector<JSVariant> *params);
 
@@ -76,7 +116,72 @@ BridgeResult opsqlite_execute_prepared_statement(
     sqlite3 *db, sqlite3_stmt *statement, std::vector<DumbHostObject> *results,
     std::shared_ptr<std::vector<SmartHostObject>> &metadatas);
 
+bool opsqlite_step_statement(sqlite3 *db, sqlite3_stmt *statement,
+                             size_t count, RowArena *rows);
+
+/// Resets the statement and reads all of its rows, the statement stays
+/// prepared for the next run. The bound values are kept when params is
+/// nullptr
+BridgeResult opsqlite_run_statement(sqlite3 *db, sqlite3_stmt *statement,
+                                    const std::vector<JSVariant> *params);
+
+/// Runs the statement once per set of params inside a savepoint, nothing is
+/// written if one of the runs fails
+BatchResult
+opsqlite_run_statement_many(sqlite3 *db, sqlite3_stmt *statement,
+                            const std::vector<std::vector<JSVariant>> &params);
+
 void opsqlite_load_extension(sqlite3 *db, std::string &path,
                              std::string &entry_point);
 
+void opsqlite_set_statement_cache_size(sqlite3 *db, size_t size);
+
+StatementCacheStats opsqlite_get_statement_cache_stats(sqlite3 *db);
+
+/// True when the query is a single statement that does not write to the
+/// database, see sqlite3_stmt_readonly
+bool opsqlite_is_readonly(sqlite3 *db, std::string const &query);
+
+/// Integers come out as doubles, like in query results
+JSVariant opsqlite_value_to_variant(sqlite3_value *value);
+
+#ifdef SQLITE_ENABLE_SESSION
+/// A change that could not be applied as is, values are only available
+/// where SQLite has them. Foreign key conflicts are reported once the whole
+/// changeset is applied and carry no change
+struct ChangesetConflict {
+  // One of the SQLITE_CHANGESET_ conflict types
+  int type;
+  std::string table;
+  // SQLITE_INSERT, SQLITE_DELETE or SQLITE_UPDATE
+  int operation = 0;
+  std::vector<JSVariant> old_values;
+  std::vector<JSVariant> new_values;
+  std::vector<JSVariant> conflicting_values;
+};
+
+ChangesetConflict opsqlite_read_conflict(int conflict_type,
+                                         sqlite3_changeset_iter *iterator);
+
+/// Returns one of the SQLITE_CHANGESET_ actions for a conflict
+using ConflictHandler =
+    std::function<int(int conflict_type, sqlite3_changeset_iter *iterator)>;
+
+/// Records the changes of the given tables of the main database, every table
+/// when empty
+sqlite3_session *opsqlite_create_session(sqlite3 *db,
+                                         std::vector<std::string> const &tables);
+
+/// Every table when table is nullptr
+void opsqlite_session_attach(sqlite3_session *session, char const *table);
+
+ArrayBuffer opsqlite_session_changeset(sqlite3_session *session,
+                                       bool is_patchset);
+
+/// Applies a changeset or a patchset in a single transaction, throws and
+/// leaves the database untouched when a conflict aborts it
+void opsqlite_apply_changeset(sqlite3 *db, ArrayBuffer const &changeset,
+                              ConflictHandler const &on_conflict);
+#endif
+
 } // namespace opsqlite
@@ -276,7 +276,7 @@ BridgeResult opsqlite_libsql_execute_prepared_statement(
         memcpy(data, value_blob.ptr, value_blob.len);
         libsql_free_blob(value_blob);
         row_host_object.values.emplace_back(
-            ArrayBuffer{.data = std::shared_ptr<uint8_t>{data},
+            ArrayBuffer{.data = std::shared_ptr<uint8_t[]>{data},
                         .size = static_cast<size_t>(value_blob.len)});
         break;
       }
@@ -350,23 +350,40 @@ libsql_stmt_t opsqlite_libsql_prepare_statement(DB const &db,
 
 BridgeResult opsqlite_libsql_execute(DB const &db, std::string const &query,
                                      const std::vector<JSVariant> *params) {
-
-  std::vector<std::string> column_names;
-  std::vector<std::vector<JSVariant>> out_rows;
-  std::vector<JSVariant> out_row;
-  libsql_rows_t rows;
-  libsql_row_t row;
   libsql_stmt_t stmt;
-  int status;
   const char *err = nullptr;
 
-  status = libsql_prepare(db.c, query.c_str(), &stmt, &err);
+  int status = libsql_prepare(db.c, query.c_str(), &stmt, &err);
 
   if (status != 0) {
     throw std::runtime_error(err);
   }
 
-  if (params != nullptr && !params->empty()) {
+  if (params != nullptr && params->empty()) {
+    params = nullptr;
+  }
+
+  try {
+    auto result = opsqlite_libsql_run_statement(db, stmt, params);
+    libsql_free_stmt(stmt);
+    return result;
+  } catch (...) {
+    libsql_free_stmt(stmt);
+    throw;
+  }
+}
+
+BridgeResult opsqlite_libsql_run_statement(DB const &db, libsql_stmt_t stmt,
+                                           const std::vector<JSVariant> *params) {
+
+  std::vector<std::string> column_names;
+  RowArena out_rows;
+  libsql_rows_t rows;
+  libsql_row_t row;
+  int status;
+  const char *err = nullptr;
+
+  if (params != nullptr) {
     opsqlite_libsql_bind_statement(stmt, params);
   }
 
@@ -388,6 +405,8 @@ BridgeResult opsqlite_libsql_execute(DB const &db, std::string const &query,
     column_names.emplace_back(col_name);
   }
 
+  out_rows.set_column_count(column_count);
+
   long long int_value;
   double float_value;
   const char *text_value;
@@ -395,8 +414,6 @@ BridgeResult opsqlite_libsql_execute(DB const &db, std::string const &query,
 
   status = libsql_next_row(rows, &row, &err);
   while (status == 0) {
-    out_row = std::vector<JSVariant>();
-
     if (!err && !row) {
       break;
     }
@@ -409,36 +426,32 @@ BridgeResult opsqlite_libsql_execute(DB const &db, std::string const &query,
       switch (type) {
       case LIBSQL_INT:
         status = libsql_get_int(row, col, &int_value, &err);
-        out_row.emplace_back(int_value);
+        out_rows.push_number(static_cast<double>(int_value));
         break;
 
       case LIBSQL_FLOAT:
         status = libsql_get_float(row, col, &float_value, &err);
-        out_row.emplace_back(float_value);
+        out_rows.push_number(float_value);
         break;
 
       case LIBSQL_TEXT:
         status = libsql_get_string(row, col, &text_value, &err);
-        out_row.emplace_back(text_value);
+        out_rows.push_text(text_value, strlen(text_value));
         break;
 
       case LIBSQL_BLOB: {
         libsql_get_blob(row, col, &blob_value, &err);
-        auto data = new uint8_t[blob_value.len];
         // You cannot share raw memory between native and JS
         // always copy the data
-        memcpy(data, blob_value.ptr, blob_value.len);
+        out_rows.push_blob(blob_value.ptr, blob_value.len);
         libsql_free_blob(blob_value);
-        out_row.emplace_back(
-            ArrayBuffer{.data = std::shared_ptr<uint8_t>{data},
-                        .size = static_cast<size_t>(blob_value.len)});
         break;
       }
 
       case LIBSQL_NULL:
         // intentional fall-through
       default:
-        out_row.emplace_back(nullptr);
+        out_rows.push_null();
         break;
       }
 
@@ -447,13 +460,12 @@ BridgeResult opsqlite_libsql_execute(DB const &db, std::string const &query,
       }
     }
 
-    out_rows.emplace_back(out_row);
     err = nullptr;
     status = libsql_next_row(rows, &row, &err);
   }
 
   libsql_free_rows(rows);
-  libsql_free_stmt(stmt);
+  libsql_reset_stmt(stmt, &err);
 
   unsigned long long changes = libsql_changes(db.c);
   long long insert_row_id = libsql_last_insert_rowid(db.c);
@@ -464,6 +476,33 @@ BridgeResult opsqlite_libsql_execute(DB const &db, std::string const &query,
           .column_names = std::move(column_names)};
 }
 
+BatchResult opsqlite_libsql_run_statement_many(
+    DB const &db, libsql_stmt_t stmt,
+    const std::vector<std::vector<JSVariant>> &params) {
+  int affected_rows = 0;
+
+  opsqlite_libsql_execute(db, "SAVEPOINT op_sqlite_run_many", nullptr);
+
+  try {
+    for (const auto &values : params) {
+      // Rows are discarded, same as in a batch
+      affected_rows +=
+          opsqlite_libsql_run_statement(db, stmt, &values).affectedRows;
+    }
+  } catch (...) {
+    opsqlite_libsql_execute(db, "ROLLBACK TO op_sqlite_run_many", nullptr);
+    opsqlite_libsql_execute(db, "RELEASE op_sqlite_run_many", nullptr);
+    throw;
+  }
+
+  opsqlite_libsql_execute(db, "RELEASE op_sqlite_run_many", nullptr);
+
+  return BatchResult{
+      .affectedRows = affected_rows,
+      .commands = static_cast<int>(params.size()),
+  };
+}
+
 BridgeResult opsqlite_libsql_execute_with_host_objects(
     DB const &db, std::string const &query,
     const std::vector<JSVariant> *params, std::vector<DumbHostObject> *results,
@@ -535,7 +574,7 @@ BridgeResult opsqlite_libsql_execute_with_host_objects(
         memcpy(data, value_blob.ptr, value_blob.len);
         libsql_free_blob(value_blob);
         row_host_object.values.emplace_back(
-            ArrayBuffer{.data = std::shared_ptr<uint8_t>{data},
+            ArrayBuffer{.data = std::shared_ptr<uint8_t[]>{data},
                         .size = static_cast<size_t>(value_blob.len)});
         break;
       }
@@ -662,7 +701,7 @@ opsqlite_libsql_execute_raw(DB const &db, std::string const &query,
         memcpy(data, value_blob.ptr, value_blob.len);
         libsql_free_blob(value_blob);
         row_vector.emplace_back(
-            ArrayBuffer{.data = std::shared_ptr<uint8_t>{data},
+            ArrayBuffer{.data = std::shared_ptr<uint8_t[]>{data},
                         .size = static_cast<size_t>(value_blob.len)});
         break;
       }
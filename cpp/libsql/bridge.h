@@ -89,4 +89,15 @@ BridgeResult opsqlite_libsql_execute_prepared_statement(
     std::vector<DumbHostObject> *results,
     const std::shared_ptr<std::vector<SmartHostObject>> &metadatas);
 
+/// Reads all the rows of the statement and resets it for the next run. The
+/// bound values are kept when params is nullptr
+BridgeResult opsqlite_libsql_run_statement(DB const &db, libsql_stmt_t stmt,
+                                           const std::vector<JSVariant> *params);
+
+/// Runs the statement once per set of params inside a savepoint, nothing is
+/// written if one of the runs fails
+BatchResult opsqlite_libsql_run_statement_many(
+    DB const &db, libsql_stmt_t stmt,
+    const std::vector<std::vector<JSVariant>> &params);
+
 } // namespace opsqlite
@@ -1,12 +1,20 @@
 #pragma once
 
+#include "RowArena.h"
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <variant>
 #include <vector>
 
+// Number of prepared statements kept around per connection
+#define DEFAULT_STATEMENT_CACHE_SIZE 64
+// Read only connections a database can open, each one holds its own file
+// handles and page cache
+#define MAX_READERS 16
+
 struct ArrayBuffer {
-  std::shared_ptr<uint8_t> data;
+  std::shared_ptr<uint8_t[]> data;
   size_t size;
 };
 
@@ -17,7 +25,7 @@ struct BridgeResult {
   std::string message;
   int affectedRows;
   double insertId;
-  std::vector<std::vector<JSVariant>> rows;
+  opsqlite::RowArena rows;
   std::vector<std::string> column_names;
 };
 
@@ -31,3 +39,29 @@ struct BatchArguments {
   std::string sql;
   std::shared_ptr<std::vector<JSVariant>> params;
 };
+
+enum ColumnarKind {
+  COLUMNAR_NULL,
+  COLUMNAR_NUMBER,
+  COLUMNAR_BIGINT,
+  COLUMNAR_TEXT,
+  COLUMNAR_BLOB,
+  COLUMNAR_MIXED
+};
+
+/// A result set column stored in contiguous buffers instead of one value per
+/// cell, see opsqlite_execute_columnar
+struct ColumnarColumn {
+  std::string name;
+  ColumnarKind kind;
+  // SQLite type of every cell (SQLITE_INTEGER, SQLITE_TEXT, etc.)
+  std::vector<uint8_t> types;
+  // INTEGER cells as int64 and FLOAT cells as double bits. Once the column is
+  // finished NUMBER columns hold only doubles and BIGINT columns only int64
+  std::vector<int64_t> numbers;
+  // TEXT and BLOB payloads, cell i spans from offsets[i] to offsets[i + 1]
+  std::vector<uint8_t> bytes;
+  std::vector<uint32_t> offsets;
+  // Bit i is set when cell i is NULL, empty if the column has no NULLs
+  std::vector<uint8_t> nulls;
+};
@@ -1,8 +1,10 @@
 #include "utils.h"
 #include "SmartHostObject.h"
+#include "macros.h"
 #ifndef OP_SQLITE_USE_LIBSQL
 #include "bridge.h"
 #endif
+#include <cmath>
 #include <fstream>
 #include <sys/stat.h>
 
@@ -10,7 +12,28 @@ namespace opsqlite {
 
 namespace jsi = facebook::jsi;
 
-inline jsi::Value to_jsi(jsi::Runtime &rt, const JSVariant &value) {
+/// The ArrayBuffer adopts the allocation, it is only safe when nothing else
+/// reads the bytes afterwards
+static jsi::Value adopt_blob(jsi::Runtime &rt,
+                             std::shared_ptr<uint8_t[]> const &owner,
+                             size_t size) {
+  auto native_buffer = std::make_shared<NativeBuffer>(owner, owner.get(), size);
+  return jsi::ArrayBuffer(rt, std::move(native_buffer));
+}
+
+/// For values read more than once, a JS write to one buffer never reaches the
+/// stored value or another buffer
+static jsi::Value copy_blob(jsi::Runtime &rt, const uint8_t *data,
+                            size_t size) {
+  std::shared_ptr<uint8_t[]> copy{new uint8_t[size]};
+  if (size > 0) {
+    memcpy(copy.get(), data, size);
+  }
+  return adopt_blob(rt, copy, size);
+}
+
+inline jsi::Value to_jsi(jsi::Runtime &rt, const JSVariant &value,
+                         bool copy_blobs) {
   if (std::holds_alternative<bool>(value)) {
     return std::get<bool>(value);
   } else if (std::holds_alternative<int>(value)) {
@@ -23,14 +46,9 @@ inline jsi::Value to_jsi(jsi::Runtime &rt, const JSVariant &value) {
     auto str = std::get<std::string>(value);
     return jsi::String::createFromUtf8(rt, str);
   } else if (std::holds_alternative<ArrayBuffer>(value)) {
-    auto jsBuffer = std::get<ArrayBuffer>(value);
-    jsi::Function array_buffer_ctor =
-        rt.global().getPropertyAsFunction(rt, "ArrayBuffer");
-    jsi::Object o = array_buffer_ctor.callAsConstructor(rt, (int)jsBuffer.size)
-                        .getObject(rt);
-    jsi::ArrayBuffer buf = o.getArrayBuffer(rt);
-    memcpy(buf.data(rt), jsBuffer.data.get(), jsBuffer.size);
-    return o;
+    auto &buffer = std::get<ArrayBuffer>(value);
+    return copy_blobs ? copy_blob(rt, buffer.data.get(), buffer.size)
+                      : adopt_blob(rt, buffer.data, buffer.size);
   }
 
   return jsi::Value::null();
@@ -71,6 +89,26 @@ inline jsi::Value to_jsi(jsi::Runtime &rt, const JSVariant &value) {
   //      value);
 }
 
+inline jsi::Value to_jsi(jsi::Runtime &rt, const RowArena &rows,
+                         const RowArena::Cell &cell, bool copy_blobs) {
+  switch (cell.type) {
+  case RowArena::CELL_NUMBER:
+    return jsi::Value(cell.number);
+
+  case RowArena::CELL_TEXT:
+    return jsi::String::createFromUtf8(rt, cell.data, cell.size);
+
+  case RowArena::CELL_BLOB:
+    // Every blob has an allocation of its own, no block is kept alive for it
+    return copy_blobs ? copy_blob(rt, cell.data, cell.size)
+                      : adopt_blob(rt, rows.get_block(cell), cell.size);
+
+  case RowArena::CELL_NULL:
+  default:
+    return jsi::Value::null();
+  }
+}
+
 inline JSVariant to_variant(jsi::Runtime &rt, const jsi::Value &value) {
   if (value.isNull() || value.isUndefined()) {
     return JSVariant(nullptr);
@@ -102,7 +140,7 @@ inline JSVariant to_variant(jsi::Runtime &rt, const jsi::Value &value) {
     uint8_t *data = new uint8_t[buffer.size(rt)];
     memcpy(data, buffer.data(rt), buffer.size(rt));
 
-    return JSVariant(ArrayBuffer{.data = std::shared_ptr<uint8_t>{data},
+    return JSVariant(ArrayBuffer{.data = std::shared_ptr<uint8_t[]>{data},
                                  .size = buffer.size(rt)});
   }
 
@@ -129,6 +167,68 @@ std::vector<int> to_int_vec(jsi::Runtime &rt, jsi::Value const &xs) {
   return res;
 }
 
+Priority to_priority(jsi::Runtime &rt, jsi::Value const &options) {
+  if (!options.isObject()) {
+    return PRIORITY_NORMAL;
+  }
+
+  auto priority = options.asObject(rt).getProperty(rt, "priority");
+  if (priority.isUndefined()) {
+    return PRIORITY_NORMAL;
+  }
+
+  auto name = priority.asString(rt).utf8(rt);
+  if (name == "interactive") {
+    return PRIORITY_INTERACTIVE;
+  }
+  if (name == "normal") {
+    return PRIORITY_NORMAL;
+  }
+  if (name == "background") {
+    return PRIORITY_BACKGROUND;
+  }
+
+  throw std::runtime_error("[op-sqlite] Unknown priority " + name);
+}
+
+double to_timeout(jsi::Runtime &rt, jsi::Value const &options) {
+  if (!options.isObject()) {
+    return 0;
+  }
+
+  auto timeout = options.asObject(rt).getProperty(rt, "timeoutMs");
+  if (timeout.isUndefined()) {
+    return 0;
+  }
+
+  if (!timeout.isNumber() || timeout.asNumber() <= 0) {
+    throw std::runtime_error(
+        "[op-sqlite] timeoutMs must be a positive number");
+  }
+
+  return timeout.asNumber();
+}
+
+size_t to_count(jsi::Runtime &rt, jsi::Value const &value, const char *name) {
+  // NaN fails every comparison, it is rejected too
+  double count = value.isNumber() ? value.asNumber() : -1;
+  if (!(count >= 0 && count <= 4294967295.0) || count != std::floor(count)) {
+    throw std::runtime_error("[op-sqlite] " + std::string(name) +
+                             " must be a non-negative integer");
+  }
+
+  return static_cast<size_t>(count);
+}
+
+void set_cancel_function(jsi::Runtime &rt, jsi::Value const &promise,
+                         std::shared_ptr<QueryCancellation> cancellation) {
+  promise.asObject(rt).setProperty(
+      rt, "cancel", HOST_STATIC_FN("cancel") {
+        cancellation->cancel();
+        return {};
+      }));
+}
+
 std::vector<JSVariant> to_variant_vec(jsi::Runtime &rt, jsi::Value const &xs) {
   std::vector<JSVariant> res;
   jsi::Array values = xs.asObject(rt).asArray(rt);
@@ -141,7 +241,53 @@ std::vector<JSVariant> to_variant_vec(jsi::Runtime &rt, jsi::Value const &xs) {
   return res;
 }
 
-jsi::Value create_js_rows(jsi::Runtime &rt, const BridgeResult &status) {
+std::vector<jsi::PropNameID>
+create_column_ids(jsi::Runtime &rt,
+                  std::vector<std::string> const &column_names) {
+  std::vector<jsi::PropNameID> column_ids;
+  column_ids.reserve(column_names.size());
+  for (auto &column_name : column_names) {
+    column_ids.emplace_back(jsi::PropNameID::forUtf8(rt, column_name));
+  }
+  return column_ids;
+}
+
+RowStrings create_row_strings(RowArena const &rows) {
+  RowStrings strings(rows.get_column_count());
+  for (size_t j = 0; j < strings.size(); j++) {
+    strings[j].resize(rows.get_dictionary_size(j));
+  }
+  return strings;
+}
+
+jsi::Value create_cell(jsi::Runtime &rt, RowArena const &rows, size_t row,
+                       size_t column, RowStrings &strings, bool copy_blobs) {
+  auto &cell = rows.at(row, column);
+
+  if (cell.entry == RowArena::NO_ENTRY) {
+    return to_jsi(rt, rows, cell, copy_blobs);
+  }
+
+  jsi::Value &string = strings[column][cell.entry];
+  if (string.isUndefined()) {
+    string = to_jsi(rt, rows, cell, copy_blobs);
+  }
+  return {rt, string};
+}
+
+jsi::Object create_row(jsi::Runtime &rt, RowArena const &rows, size_t row,
+                       std::vector<jsi::PropNameID> const &column_ids,
+                       RowStrings &strings, bool copy_blobs) {
+  auto object = jsi::Object(rt);
+  for (size_t j = 0; j < rows.get_column_count(); j++) {
+    object.setProperty(rt, column_ids[j],
+                       create_cell(rt, rows, row, j, strings, copy_blobs));
+  }
+  return object;
+}
+
+jsi::Value create_js_rows(jsi::Runtime &rt, const BridgeResult &status,
+                          bool with_raw_rows) {
   jsi::Object res = jsi::Object(rt);
 
   res.setProperty(rt, "rowsAffected", status.affectedRows);
@@ -153,17 +299,20 @@ jsi::Value create_js_rows(jsi::Runtime &rt, const BridgeResult &status) {
   auto rows = jsi::Array(rt, row_count);
 
   if (row_count > 0) {
+    std::vector<jsi::PropNameID> column_ids =
+        create_column_ids(rt, status.column_names);
+    RowStrings strings = create_row_strings(status.rows);
+
     for (int i = 0; i < row_count; i++) {
-      auto row = jsi::Array(rt, status.column_names.size());
-      std::vector<JSVariant> native_row = status.rows[i];
-      for (int j = 0; j < native_row.size(); j++) {
-        auto value = to_jsi(rt, native_row[j]);
-        row.setValueAtIndex(rt, j, value);
-      }
-      rows.setValueAtIndex(rt, i, row);
+      rows.setValueAtIndex(
+          rt, i, create_row(rt, status.rows, i, column_ids, strings));
     }
   }
-  res.setProperty(rt, "rawRows", rows);
+  res.setProperty(rt, "rows", std::move(rows));
+  if (with_raw_rows) {
+    // The row objects already hold the blobs
+    res.setProperty(rt, "rawRows", create_raw_result(rt, status, true));
+  }
 
   size_t column_count = status.column_names.size();
   auto column_array = jsi::Array(rt, column_count);
@@ -175,6 +324,22 @@ jsi::Value create_js_rows(jsi::Runtime &rt, const BridgeResult &status) {
   return res;
 }
 
+jsi::Array create_row_objects(jsi::Runtime &rt,
+                              std::vector<DumbHostObject> *results,
+                              std::shared_ptr<ColumnIndex> const &index) {
+  size_t rowCount = results->size();
+
+  auto array = jsi::Array(rt, rowCount);
+  for (int i = 0; i < rowCount; i++) {
+    auto row = std::make_shared<DumbHostObject>(results->at(i));
+    row->index = index;
+    array.setValueAtIndex(rt, i,
+                          jsi::Object::createFromHostObject(rt, row));
+  }
+
+  return array;
+}
+
 jsi::Value
 create_result(jsi::Runtime &rt, const BridgeResult &status,
               std::vector<DumbHostObject> *results,
@@ -186,16 +351,8 @@ create_result(jsi::Runtime &rt, const BridgeResult &status,
     res.setProperty(rt, "insertId", jsi::Value(status.insertId));
   }
 
-  size_t rowCount = results->size();
-
-  auto array = jsi::Array(rt, rowCount);
-  for (int i = 0; i < rowCount; i++) {
-    auto obj = results->at(i);
-    array.setValueAtIndex(rt, i,
-                          jsi::Object::createFromHostObject(
-                              rt, std::make_shared<DumbHostObject>(obj)));
-  }
-  res.setProperty(rt, "rows", std::move(array));
+  auto index = std::make_shared<ColumnIndex>(rt, *metadata);
+  res.setProperty(rt, "rows", create_row_objects(rt, results, index));
 
   size_t column_count = metadata->size();
   auto column_array = jsi::Array(rt, column_count);
@@ -227,6 +384,154 @@ create_raw_result(jsi::Runtime &rt, const BridgeResult &status,
   return res;
 }
 
+jsi::Value create_raw_result(jsi::Runtime &rt, const BridgeResult &status,
+                             bool copy_blobs) {
+  size_t row_count = status.rows.size();
+  size_t column_count = status.rows.get_column_count();
+  RowStrings strings = create_row_strings(status.rows);
+
+  jsi::Array res = jsi::Array(rt, row_count);
+  for (size_t i = 0; i < row_count; i++) {
+    auto array = jsi::Array(rt, column_count);
+    for (size_t j = 0; j < column_count; j++) {
+      array.setValueAtIndex(
+          rt, j, create_cell(rt, status.rows, i, j, strings, copy_blobs));
+    }
+    res.setValueAtIndex(rt, i, array);
+  }
+  return res;
+}
+
+/// Copies native memory into a new JS ArrayBuffer
+jsi::Object create_array_buffer(jsi::Runtime &rt,
+                                jsi::Function const &array_buffer_ctor,
+                                const void *data, size_t size) {
+  jsi::Object o = array_buffer_ctor.callAsConstructor(rt, static_cast<int>(size))
+                      .getObject(rt);
+  if (size > 0) {
+    jsi::ArrayBuffer buf = o.getArrayBuffer(rt);
+    memcpy(buf.data(rt), data, size);
+  }
+  return o;
+}
+
+std::string columnar_kind_to_string(ColumnarKind kind) {
+  switch (kind) {
+  case COLUMNAR_NUMBER:
+    return "number";
+  case COLUMNAR_BIGINT:
+    return "bigint";
+  case COLUMNAR_TEXT:
+    return "text";
+  case COLUMNAR_BLOB:
+    return "blob";
+  case COLUMNAR_MIXED:
+    return "mixed";
+  case COLUMNAR_NULL:
+  default:
+    return "null";
+  }
+}
+
+jsi::Value create_columnar_result(jsi::Runtime &rt, const BridgeResult &status,
+                                  const std::vector<ColumnarColumn> *columns,
+                                  size_t row_count) {
+  jsi::Object res = jsi::Object(rt);
+
+  res.setProperty(rt, "rowsAffected", status.affectedRows);
+  if (status.affectedRows > 0 && status.insertId != 0) {
+    res.setProperty(rt, "insertId", jsi::Value(status.insertId));
+  }
+  res.setProperty(rt, "length", jsi::Value(static_cast<double>(row_count)));
+
+  auto array_buffer_ctor = rt.global().getPropertyAsFunction(rt, "ArrayBuffer");
+  auto js_columns = jsi::Array(rt, columns->size());
+
+  for (size_t i = 0; i < columns->size(); i++) {
+    const auto &column = columns->at(i);
+    auto js_column = jsi::Object(rt);
+
+    js_column.setProperty(rt, "name",
+                          jsi::String::createFromUtf8(rt, column.name));
+    js_column.setProperty(
+        rt, "type",
+        jsi::String::createFromAscii(rt, columnar_kind_to_string(column.kind)));
+
+    switch (column.kind) {
+    case COLUMNAR_NUMBER:
+    case COLUMNAR_BIGINT:
+      js_column.setProperty(
+          rt, "data",
+          create_array_buffer(rt, array_buffer_ctor, column.numbers.data(),
+                              column.numbers.size() * sizeof(int64_t)));
+      break;
+
+    case COLUMNAR_TEXT:
+    case COLUMNAR_BLOB:
+      js_column.setProperty(rt, "data",
+                            create_array_buffer(rt, array_buffer_ctor,
+                                                column.bytes.data(),
+                                                column.bytes.size()));
+      js_column.setProperty(
+          rt, "offsets",
+          create_array_buffer(rt, array_buffer_ctor, column.offsets.data(),
+                              column.offsets.size() * sizeof(uint32_t)));
+      break;
+
+    case COLUMNAR_MIXED: {
+      auto values = jsi::Array(rt, row_count);
+      for (size_t j = 0; j < row_count; j++) {
+        const uint8_t *bytes = column.bytes.data() + column.offsets[j];
+        size_t size = column.offsets[j + 1] - column.offsets[j];
+
+        switch (column.types[j]) {
+        case SQLITE_INTEGER:
+          values.setValueAtIndex(
+              rt, j, jsi::Value(static_cast<double>(column.numbers[j])));
+          break;
+        case SQLITE_FLOAT: {
+          double value;
+          memcpy(&value, &column.numbers[j], sizeof(double));
+          values.setValueAtIndex(rt, j, jsi::Value(value));
+          break;
+        }
+        case SQLITE_TEXT:
+          values.setValueAtIndex(rt, j,
+                                 jsi::String::createFromUtf8(rt, bytes, size));
+          break;
+        case SQLITE_BLOB:
+          values.setValueAtIndex(
+              rt, j, create_array_buffer(rt, array_buffer_ctor, bytes, size));
+          break;
+        default:
+          values.setValueAtIndex(rt, j, jsi::Value::null());
+          break;
+        }
+      }
+      js_column.setProperty(rt, "values", std::move(values));
+      break;
+    }
+
+    case COLUMNAR_NULL:
+    default:
+      break;
+    }
+
+    if (!column.nulls.empty()) {
+      js_column.setProperty(rt, "nulls",
+                            create_array_buffer(rt, array_buffer_ctor,
+                                                column.nulls.data(),
+                                                column.nulls.size()));
+    }
+
+    js_columns.setValueAtIndex(rt, i, std::move(js_column));
+  }
+
+  res.setProperty(rt, "columns", std::move(js_columns));
+
+  return res;
+}
+
 void to_batch_arguments(jsi::Runtime &rt, jsi::Array const &batch_params,
                         std::vector<BatchArguments> *commands) {
   for (int i = 0; i < batch_params.length(rt); i++) {
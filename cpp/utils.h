@@ -1,7 +1,9 @@
 #pragma once
 
 #include "DumbHostObject.h"
+#include "QueryCancellation.h"
 #include "SmartHostObject.h"
+#include "ThreadPool.h"
 #include "types.h"
 #include <jsi/jsi.h>
 #include <sqlite3.h>
@@ -12,7 +14,27 @@ namespace opsqlite {
 
 namespace jsi = facebook::jsi;
 
-jsi::Value to_jsi(jsi::Runtime &rt, const JSVariant &value);
+/// Native memory handed to a JS ArrayBuffer without copying it, the owner is
+/// kept alive until the ArrayBuffer is garbage collected
+class NativeBuffer : public jsi::MutableBuffer {
+public:
+  NativeBuffer(std::shared_ptr<uint8_t[]> owner, uint8_t *data, size_t size)
+      : _owner(std::move(owner)), _data(data), _size(size) {}
+
+  size_t size() const override { return _size; }
+  uint8_t *data() override { return _data; }
+
+private:
+  std::shared_ptr<uint8_t[]> _owner;
+  uint8_t *_data;
+  size_t _size;
+};
+
+/// Blobs are handed to the ArrayBuffer without copying them. Values read
+/// again later, e.g. by a host object, pass copy_blobs so that every read gets
+/// bytes of its own
+jsi::Value to_jsi(jsi::Runtime &rt, const JSVariant &value,
+                  bool copy_blobs = false);
 
 JSVariant to_variant(jsi::Runtime &rt, jsi::Value const &value);
 
@@ -22,17 +44,72 @@ std::vector<JSVariant> to_variant_vec(jsi::Runtime &rt, jsi::Value const &xs);
 
 std::vector<int> to_int_vec(jsi::Runtime &rt, jsi::Value const &xs);
 
+/// Reads the priority of an options object ({ priority: 'background' }),
+/// tasks are queued as PRIORITY_NORMAL when it is missing
+Priority to_priority(jsi::Runtime &rt, jsi::Value const &options);
+
+/// Reads the timeoutMs of an options object, 0 when there is none
+double to_timeout(jsi::Runtime &rt, jsi::Value const &options);
+
+/// Reads an option that counts something, throws unless it is a non-negative
+/// integer that fits in a size_t
+size_t to_count(jsi::Runtime &rt, jsi::Value const &value, const char *name);
+
+/// Adds a cancel function to the promise of a query
+void set_cancel_function(jsi::Runtime &rt, jsi::Value const &promise,
+                         std::shared_ptr<QueryCancellation> cancellation);
+
+/// Copies native memory into a new JS ArrayBuffer
+jsi::Object create_array_buffer(jsi::Runtime &rt,
+                                jsi::Function const &array_buffer_ctor,
+                                const void *data, size_t size);
+
+/// Rows of a result as host objects sharing the same column lookup
+jsi::Array create_row_objects(jsi::Runtime &rt,
+                              std::vector<DumbHostObject> *results,
+                              std::shared_ptr<ColumnIndex> const &index);
+
 jsi::Value
 create_result(jsi::Runtime &rt, const BridgeResult &status,
               std::vector<DumbHostObject> *results,
               std::shared_ptr<std::vector<SmartHostObject>> metadata);
 
-jsi::Value create_js_rows(jsi::Runtime &rt, const BridgeResult &status);
+/// JS strings already created for the dictionary entries of each column,
+/// repeated values reuse the same string instead of creating a new one
+typedef std::vector<std::vector<jsi::Value>> RowStrings;
+
+/// Property names are created once per result instead of once per cell
+std::vector<jsi::PropNameID>
+create_column_ids(jsi::Runtime &rt,
+                  std::vector<std::string> const &column_names);
+
+RowStrings create_row_strings(RowArena const &rows);
+
+/// See to_jsi for copy_blobs
+jsi::Value create_cell(jsi::Runtime &rt, RowArena const &rows, size_t row,
+                       size_t column, RowStrings &strings,
+                       bool copy_blobs = false);
+
+jsi::Object create_row(jsi::Runtime &rt, RowArena const &rows, size_t row,
+                       std::vector<jsi::PropNameID> const &column_ids,
+                       RowStrings &strings, bool copy_blobs = false);
+
+/// Rows as objects, with_raw_rows also adds them as arrays of values
+jsi::Value create_js_rows(jsi::Runtime &rt, const BridgeResult &status,
+                          bool with_raw_rows = false);
 
 jsi::Value
 create_raw_result(jsi::Runtime &rt, const BridgeResult &status,
                   const std::vector<std::vector<JSVariant>> *results);
 
+/// Rows of the result as arrays of values, without column names
+jsi::Value create_raw_result(jsi::Runtime &rt, const BridgeResult &status,
+                             bool copy_blobs = false);
+
+jsi::Value create_columnar_result(jsi::Runtime &rt, const BridgeResult &status,
+                                  const std::vector<ColumnarColumn> *columns,
+                                  size_t row_count);
+
 void to_batch_arguments(jsi::Runtime &rt, jsi::Array const &batch_params,
                         std::vector<BatchArguments> *commands);
 
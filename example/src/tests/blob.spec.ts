@@ -43,6 +43,21 @@ export function blobTests() {
       expect(finalUint8[0]).to.equal(42);
     });
 
+    it('Blobs read from a host object are independent copies', async () => {
+      await db.execute(`INSERT OR REPLACE INTO BlobTable VALUES (?, ?);`, [
+        1,
+        new Uint8Array([42, 43]),
+      ]);
+
+      const result = await db.executeWithHostObjects(
+        'SELECT content FROM BlobTable;',
+      );
+      const row = result.rows[0]!;
+
+      new Uint8Array(row.content as any)[0] = 0;
+      expect(new Uint8Array(row.content as any)[0]).to.equal(42);
+    });
+
     it('Uint8Array', async () => {
       const uint8 = new Uint8Array(2);
       uint8[0] = 42;
@@ -86,6 +86,73 @@ export function dbSetupTests() {
       });
     }
 
+    if (!isLibsql()) {
+      it('Reads on reader connections', async () => {
+        let db = open({
+          name: 'readersTest.sqlite',
+          encryptionKey: 'test',
+          readers: 2,
+        });
+
+        await db.execute('DROP TABLE IF EXISTS User;');
+        await db.execute(
+          'CREATE TABLE User ( id INT PRIMARY KEY, name TEXT NOT NULL) STRICT;',
+        );
+        await db.execute('INSERT INTO User (id, name) VALUES (?, ?)', [
+          1,
+          'Ada',
+        ]);
+
+        const [first, second] = await Promise.all([
+          db.execute('SELECT name FROM User WHERE id = ?', [1]),
+          db.executeRaw('SELECT count(*) FROM User'),
+        ]);
+
+        expect(first.rows[0]!.name).to.equal('Ada');
+        expect(second[0][0]).to.equal(1);
+
+        const mode = await db.execute('PRAGMA journal_mode');
+        expect(mode.rows[0]!.journal_mode).to.equal('wal');
+
+        db.delete();
+      });
+
+      it('Reads follow a transaction begun outside of execute', async () => {
+        let db = open({
+          name: 'readersTransactionTest.sqlite',
+          encryptionKey: 'test',
+          readers: 2,
+        });
+
+        await db.execute('DROP TABLE IF EXISTS User;');
+        await db.execute(
+          'CREATE TABLE User ( id INT PRIMARY KEY, name TEXT NOT NULL) STRICT;',
+        );
+
+        db.executeSync('BEGIN');
+        await db.execute('INSERT INTO User (id, name) VALUES (?, ?)', [
+          1,
+          'Ada',
+        ]);
+
+        const inside = await db.execute('SELECT count(*) AS count FROM User');
+        expect(inside.rows[0]!.count).to.equal(1);
+
+        await db.execute('ROLLBACK');
+
+        const after = await db.execute('SELECT count(*) AS count FROM User');
+        expect(after.rows[0]!.count).to.equal(0);
+
+        db.delete();
+      });
+
+      it('Rejects too many readers', () => {
+        expect(() =>
+          open({name: 'tooManyReaders.sqlite', readers: 17}),
+        ).to.throw();
+      });
+    }
+
     it('Should load extension', async () => {
       let db = open({
         name: 'extensionDb',
@@ -42,7 +42,7 @@ export function registerHooksTests() {
     it('update hook', async () => {
       let promiseResolve: any;
       let promise = new Promise<{
-        rowId: number;
+        rowId: number | bigint;
         row?: any;
         operation: string;
         table: string;
@@ -105,6 +105,250 @@ export function registerHooksTests() {
       expect(hookRes.length).to.equal(1);
     });
 
+    it('update hook only sends committed changes', async () => {
+      const hookRes: string[] = [];
+
+      db.updateHook(({operation, table}) => {
+        hookRes.push(`${operation} ${table}`);
+      });
+
+      try {
+        await db.transaction(async tx => {
+          await tx.execute(
+            'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)',
+            [1, chance.name(), chance.integer(), chance.floating()],
+          );
+          throw new Error('rollback');
+        });
+      } catch (e) {
+        // expected
+      }
+
+      await db.transaction(async tx => {
+        await tx.execute(
+          'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)',
+          [2, chance.name(), chance.integer(), chance.floating()],
+        );
+        await tx.execute('UPDATE "User" SET age = ? WHERE id = ?', [1, 2]);
+      });
+
+      await sleep(0);
+
+      expect(hookRes).to.deep.equal(['INSERT User', 'UPDATE User']);
+
+      db.updateHook(null);
+    });
+
+    it('update hook skips rolled back savepoints and keeps big row ids', async () => {
+      const rowIds: Array<number | bigint> = [];
+
+      db.updateHook(({rowId}) => {
+        rowIds.push(rowId);
+      });
+
+      await db.transaction(async tx => {
+        await tx.execute(
+          'INSERT INTO "User" (rowid, id, name, age, networth) VALUES(?, ?, ?, ?, ?)',
+          [1, 1, chance.name(), chance.integer(), chance.floating()],
+        );
+
+        try {
+          await tx.savepoint(async nested => {
+            await nested.execute(
+              'INSERT INTO "User" (rowid, id, name, age, networth) VALUES(?, ?, ?, ?, ?)',
+              [2, 2, chance.name(), chance.integer(), chance.floating()],
+            );
+            throw new Error('rollback');
+          });
+        } catch (e) {
+          // expected
+        }
+
+        await tx.execute(
+          'INSERT INTO "User" (rowid, id, name, age, networth) VALUES(9007199254740993, ?, ?, ?, ?)',
+          [3, chance.name(), chance.integer(), chance.floating()],
+        );
+      });
+
+      await sleep(0);
+
+      expect(rowIds).to.deep.equal([1, BigInt('9007199254740993')]);
+
+      db.updateHook(null);
+    });
+
+    it('change hook captures old and new values', async () => {
+      const changes: any[] = [];
+
+      db.changeHook(
+        batch => {
+          changes.push(...batch.changes);
+        },
+        {tables: [{table: 'User', columns: ['name', 'age']}]},
+      );
+
+      await db.transaction(async tx => {
+        await tx.execute(
+          'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)',
+          [1, 'John', 30, 1000],
+        );
+        await tx.execute('UPDATE "User" SET age = ? WHERE id = ?', [31, 1]);
+      });
+
+      await db.execute('DELETE FROM "User" WHERE id = ?', [1]);
+
+      await sleep(20);
+
+      expect(changes.length).to.equal(3);
+      expect(changes[0].operation).to.equal('INSERT');
+      expect(changes[0].oldValues).to.equal(undefined);
+      expect(changes[0].newValues).to.deep.equal({name: 'John', age: 30});
+      expect(changes[1].oldValues).to.deep.equal({name: 'John', age: 30});
+      expect(changes[1].newValues).to.deep.equal({name: 'John', age: 31});
+      expect(changes[2].operation).to.equal('DELETE');
+      expect(changes[2].newValues).to.equal(undefined);
+
+      db.changeHook(null);
+    });
+
+    it('change hook drops the changes of a rolled back savepoint', async () => {
+      const changes: any[] = [];
+
+      db.changeHook(batch => {
+        changes.push(...batch.changes);
+      });
+
+      await db.transaction(async tx => {
+        await tx.execute(
+          'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)',
+          [1, 'John', 30, 1000],
+        );
+
+        try {
+          await tx.savepoint(async nested => {
+            await nested.execute(
+              'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)',
+              [2, 'Jane', 25, 2000],
+            );
+            throw new Error('rollback');
+          });
+        } catch (e) {
+          // expected
+        }
+
+        await tx.execute('UPDATE "User" SET age = ? WHERE id = ?', [31, 1]);
+      });
+
+      await sleep(20);
+
+      expect(changes.map(change => change.operation)).to.deep.equal([
+        'INSERT',
+        'UPDATE',
+      ]);
+      expect(changes[0].newValues.name).to.equal('John');
+
+      db.changeHook(null);
+    });
+
+    it('session changeset can be applied back', async () => {
+      const session = db.createSession(['User']);
+
+      await db.execute(
+        'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)',
+        [1, 'John', 30, 1000],
+      );
+
+      expect(session.isEmpty()).to.equal(false);
+      const changeset = await session.changeset();
+      await session.close();
+
+      await db.execute('DELETE FROM "User"');
+      await db.applyChangeset(changeset);
+
+      let res = await db.execute('SELECT name FROM "User"');
+      expect(res.rows).to.deep.equal([{name: 'John'}]);
+
+      // The row exists now, the insert conflicts with it
+      await db.execute('UPDATE "User" SET name = ? WHERE id = ?', ['Jane', 1]);
+      const conflicts: string[] = [];
+      await db.applyChangeset(changeset, {
+        onConflict: conflict => {
+          conflicts.push(conflict.type);
+          return 'replace';
+        },
+      });
+
+      res = await db.execute('SELECT name FROM "User"');
+      expect(conflicts).to.deep.equal(['conflict']);
+      expect(res.rows).to.deep.equal([{name: 'John'}]);
+    });
+
+    it('session records changes while other hooks are registered', async () => {
+      const operations: string[] = [];
+      db.updateHook(({operation}) => {
+        operations.push(operation);
+      });
+      const unsubscribe = db.reactiveExecute({
+        query: 'SELECT name FROM User',
+        arguments: [],
+        fireOn: [{table: 'User'}],
+        callback: () => {},
+      });
+
+      const session = db.createSession(['User']);
+      expect(() => db.changeHook(() => {})).to.throw();
+
+      await db.execute(
+        'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)',
+        [1, 'John', 30, 1000],
+      );
+      // Removing the hooks leaves the session recording
+      db.updateHook(null);
+      unsubscribe();
+      await db.execute('UPDATE "User" SET name = ? WHERE id = ?', ['Jane', 1]);
+
+      expect(session.isEmpty()).to.equal(false);
+      const changeset = await session.changeset();
+      await session.close();
+      expect(operations).to.deep.equal(['INSERT']);
+
+      await db.execute('DELETE FROM "User"');
+      await db.applyChangeset(changeset);
+      const res = await db.execute('SELECT name FROM "User"');
+      expect(res.rows).to.deep.equal([{name: 'Jane'}]);
+
+      db.changeHook(() => {});
+      expect(() => db.createSession(['User'])).to.throw();
+      db.changeHook(null);
+    });
+
+    it('changeset conflict callback can query the database', async () => {
+      const session = db.createSession(['User']);
+
+      await db.execute(
+        'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)',
+        [1, 'John', 30, 1000],
+      );
+
+      const changeset = await session.changeset();
+      await session.close();
+
+      await db.execute('UPDATE "User" SET name = ? WHERE id = ?', ['Jane', 1]);
+      const names: unknown[] = [];
+      await db.applyChangeset(changeset, {
+        onConflict: () => {
+          // Used to deadlock, the database waited on the callback
+          const res = db.executeSync('SELECT name FROM "User" WHERE id = 1');
+          names.push(res.rows[0]!.name);
+          return 'omit';
+        },
+      });
+
+      const res = await db.execute('SELECT name FROM "User"');
+      expect(names).to.deep.equal(['Jane']);
+      expect(res.rows).to.deep.equal([{name: 'Jane'}]);
+    });
+
     it('commit hook', async () => {
       let promiseResolve: any;
       let promise = new Promise(resolve => {
@@ -82,5 +82,48 @@ export function preparedStatementsTests() {
       await statement.bind([5, 'Pedro']);
       await statement.execute();
     });
+
+    it('prepared statement, run binds and executes at once', async () => {
+      const statement = db.prepareStatement('SELECT * FROM User WHERE id = ?;');
+
+      let results = await statement.run([1]);
+      expect(results.rows).to.deep.equal([{id: 1, name: 'Oscar'}]);
+
+      // Keeps the values bound before
+      results = await statement.run();
+      expect(results.rows[0]!.name).to.equal('Oscar');
+
+      const raw = await statement.runRaw([2]);
+      expect(raw).to.deep.equal([[2, 'Pablo']]);
+
+      results = statement.runSync([3]);
+      expect(results.rows[0]!.name).to.equal('Carlos');
+    });
+
+    it('prepared statement, runMany inserts all rows or none', async () => {
+      const statement = db.prepareStatement(
+        'INSERT INTO "User" (id, name) VALUES(?,?);',
+      );
+
+      const res = await statement.runMany([
+        [4, 'Juan'],
+        [5, 'Pedro'],
+      ]);
+      expect(res.rowsAffected).to.equal(2);
+
+      let error: unknown;
+      try {
+        await statement.runMany([
+          [6, 'Maria'],
+          [1, 'Duplicate'],
+        ]);
+      } catch (e) {
+        error = e;
+      }
+      expect(error).to.be.instanceOf(Error);
+
+      const count = await db.execute('SELECT COUNT(*) as count FROM User;');
+      expect(count.rows[0]!.count).to.equal(5);
+    });
   });
 }
@@ -276,6 +276,32 @@ export function queriesTests() {
       expect(minRes.rows[0]!.min).to.equal(minNetworth);
     });
 
+    it('Query with repeated text values', async () => {
+      const statuses = ['active', 'inactive', 'pending'];
+      await db.executeBatch([
+        [
+          'INSERT INTO User (id, name, age, networth, nickname) VALUES(?, ?, ?, ?, ?)',
+          Array.from({length: 2000}, (_, i) => [
+            i,
+            statuses[i % 3]!,
+            i,
+            i,
+            `nickname ${i}`,
+          ]),
+        ],
+      ]);
+
+      const res = await db.execute(
+        'SELECT name, nickname FROM User ORDER BY id',
+      );
+
+      expect(res.rows.length).to.equal(2000);
+      for (let i = 0; i < res.rows.length; i++) {
+        expect(res.rows[i]!.name).to.equal(statuses[i % 3]);
+        expect(res.rows[i]!.nickname).to.equal(`nickname ${i}`);
+      }
+    });
+
     it('Executes all the statements in a single string', async () => {
       if (isLibsql()) {
         return;
@@ -576,6 +602,89 @@ export function queriesTests() {
       expect(ranCallback).to.equal(true, 'Should handle async callback');
     });
 
+    it('Transaction, savepoint rolls back only its changes', async () => {
+      const id1 = chance.integer();
+      const id2 = chance.integer();
+
+      await db.transaction(async tx => {
+        await tx.execute(
+          'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)',
+          [id1, chance.name(), chance.integer(), chance.floating()],
+        );
+
+        try {
+          await tx.savepoint(async nested => {
+            await nested.execute(
+              'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)',
+              [id2, chance.name(), chance.integer(), chance.floating()],
+            );
+            throw new Error('Nested error');
+          });
+        } catch (e) {
+          expect((e as Error).message).to.equal('Nested error');
+        }
+      });
+
+      const res = await db.execute('SELECT id FROM User');
+      expect(res.rows).to.eql([{id: id1}]);
+    });
+
+    it('Transaction, queued transactions run one after the other', async () => {
+      const ids = [chance.integer(), chance.integer(), chance.integer()];
+
+      await Promise.all(
+        ids.map(id =>
+          db.transaction(async tx => {
+            tx.execute(
+              'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)',
+              [id, chance.name(), chance.integer(), chance.floating()],
+            );
+            await tx.execute('SELECT * FROM User');
+          }),
+        ),
+      );
+
+      const res = await db.execute('SELECT id FROM User');
+      expect(res.rows).to.have.deep.members(ids.map(id => ({id})));
+    });
+
+    it('Transaction, waiting transactions committed without awaiting keep their order', async () => {
+      const ids = [chance.integer(), chance.integer(), chance.integer()];
+      const insert =
+        'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)';
+
+      await Promise.all([
+        db.transaction(async tx => {
+          await tx.execute(insert, [
+            ids[0],
+            chance.name(),
+            chance.integer(),
+            chance.floating(),
+          ]);
+          await tx.execute('SELECT * FROM User');
+        }),
+        db.transaction(async tx => {
+          tx.execute(insert, [
+            ids[1],
+            chance.name(),
+            chance.integer(),
+            chance.floating(),
+          ]);
+        }),
+        db.transaction(async tx => {
+          tx.execute(insert, [
+            ids[2],
+            chance.name(),
+            chance.integer(),
+            chance.floating(),
+          ]);
+        }),
+      ]);
+
+      const res = await db.execute('SELECT id FROM User');
+      expect(res.rows).to.have.deep.members(ids.map(id => ({id})));
+    });
+
     it('Batch execute', async () => {
       const id1 = chance.integer();
       const name1 = chance.name();
@@ -614,6 +723,129 @@ export function queriesTests() {
       ]);
     });
 
+    it('Batch execute with many parameter sets', async () => {
+      const params = [];
+      for (let i = 0; i < 1000; i++) {
+        params.push([i, chance.name(), chance.integer(), chance.floating()]);
+      }
+
+      const res = await db.executeBatch([
+        [
+          'INSERT INTO "User" (id, name, age, networth) VALUES(?, ?, ?, ?)',
+          params,
+        ],
+        ['UPDATE User SET age = 1 WHERE id < 10'],
+        ['DELETE FROM User WHERE id = ?', [0]],
+      ]);
+
+      expect(res.rowsAffected).to.equal(1011);
+
+      const count = await db.execute('SELECT COUNT(*) as count FROM User');
+      expect(count.rows[0]!.count).to.equal(999);
+    });
+
+    it('Batch execute rolls back on failure', async () => {
+      await db.executeBatch([
+        ['INSERT INTO "User" (id, name) VALUES(?, ?)', [1, 'Oscar']],
+      ]);
+
+      let failed = false;
+      try {
+        await db.executeBatch([
+          [
+            'INSERT INTO "User" (id, name) VALUES(?, ?)',
+            [
+              [2, 'Pablo'],
+              [1, 'Duplicated'],
+            ],
+          ],
+        ]);
+      } catch (e) {
+        failed = true;
+      }
+
+      expect(failed).to.equal(true);
+      const res = await db.execute('SELECT * FROM User');
+      expect(res.rows.length).to.equal(1);
+    });
+
+    it('Result set reads rows on demand', async () => {
+      await db.executeBatch([
+        [
+          'INSERT INTO User (id, name, age, networth) VALUES(?, ?, ?, ?)',
+          [
+            [1, 'Oscar', 30, 1.5],
+            [2, 'Pablo', null, 2.5],
+          ],
+        ],
+      ]);
+
+      const res = await db.executeResultSet(
+        'SELECT id, name, age FROM User ORDER BY id',
+      );
+
+      expect(res.length).to.equal(2);
+      expect(res.columnNames).to.eql(['id', 'name', 'age']);
+      expect(res.getRow(1)).to.eql({id: 2, name: 'Pablo', age: null});
+      expect(res.getValue(0, 'name')).to.equal('Oscar');
+      expect(res.getValue(0, 2)).to.equal(30);
+      expect(() => res.getRow(2)).to.throw();
+
+      res.free();
+
+      expect(res.length).to.equal(0);
+      expect(() => res.getRow(0)).to.throw();
+    });
+
+    it('Runs interactive queries before background ones', async () => {
+      const order: string[] = [];
+
+      // Keeps the database busy while the other two are queued
+      const slow = db.execute(
+        'WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < 1000000) SELECT count(*) AS total FROM c',
+      );
+      const background = db
+        .executeBatch([['SELECT 1']], {priority: 'background'})
+        .then(() => order.push('background'));
+      const interactive = db
+        .execute('SELECT 1', [], {priority: 'interactive'})
+        .then(() => order.push('interactive'));
+
+      await Promise.all([slow, background, interactive]);
+
+      expect(order).to.eql(['interactive', 'background']);
+      expect(db.getQueueStats()).to.eql({
+        interactive: 0,
+        normal: 0,
+        background: 0,
+      });
+    });
+
+    it('Cancels queries', async () => {
+      // Never finishes on its own
+      const endless = db.execute(
+        'WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) SELECT count(*) AS total FROM c',
+      );
+      const expired = db.execute('SELECT 1', [], {timeoutMs: 1});
+
+      setTimeout(() => endless.cancel(), 100);
+
+      const errors = await Promise.all(
+        [endless, expired].map(promise =>
+          promise.then(
+            () => '',
+            (e: Error) => e.message,
+          ),
+        ),
+      );
+
+      expect(errors[0]).to.contain('interrupted');
+      expect(errors[1]).to.contain('timed out');
+
+      const res = await db.execute('SELECT 1 AS one');
+      expect(res.rows).to.eql([{one: 1}]);
+    });
+
     it('DumbHostObject allows to write known props', async () => {
       const id = chance.integer();
       const name = chance.name();
@@ -669,6 +901,10 @@ export function queriesTests() {
       res.rows[0]!.myWeirdProp = 'quack_changed';
 
       expect(res.rows[0]!.myWeirdProp).to.eq('quack_changed');
+
+      res.rows[0]!.myWeirdProp = 'quack_changed_again';
+
+      expect(res.rows[0]!.myWeirdProp).to.eq('quack_changed_again');
     });
 
     it('Execute raw should return just an array of objects', async () => {
@@ -687,6 +923,117 @@ export function queriesTests() {
       expect(res).to.eql([[id, name, age, networth]]);
     });
 
+    if (!isLibsql()) {
+      it('Reuses cached statements for repeated queries', async () => {
+        const before = db.getStatementCacheStats();
+
+        for (let i = 0; i < 10; i++) {
+          await db.execute('SELECT * FROM User WHERE id = ?', [i]);
+        }
+
+        const after = db.getStatementCacheStats();
+        expect(after.hits - before.hits).to.be.at.least(9);
+        expect(after.size).to.be.at.most(after.capacity);
+      });
+
+      it('Cached statements see schema changes', async () => {
+        await db.execute('INSERT INTO User (id, name) VALUES(?, ?)', [
+          1,
+          'Oscar',
+        ]);
+        await db.execute('SELECT * FROM User');
+        await db.execute('ALTER TABLE User ADD COLUMN email TEXT');
+
+        const res = await db.execute('SELECT * FROM User');
+        expect(res.rows[0]).to.have.property('email', null);
+      });
+
+      it('Execute columnar', async () => {
+        await db.executeBatch([
+          [
+            'INSERT INTO User (id, name, age, networth) VALUES(?, ?, ?, ?)',
+            [
+              [1, 'Oscar', 30, 1.5],
+              [2, 'Pablo', null, 2.5],
+            ],
+          ],
+        ]);
+
+        const res = await db.executeColumnar(
+          'SELECT id, name, age, networth, nickname FROM User ORDER BY id',
+        );
+
+        expect(res.length).to.equal(2);
+        const [id, name, age, networth, nickname] = res.columns;
+
+        expect(id!.type).to.equal('number');
+        expect(Array.from(id!.data as Float64Array)).to.eql([1, 2]);
+        expect(id!.nulls).to.equal(undefined);
+
+        expect(name!.type).to.equal('text');
+        expect(Array.from(name!.offsets!)).to.eql([0, 5, 10]);
+        expect((name!.data as Uint8Array)[0]).to.equal('O'.charCodeAt(0));
+
+        expect(age!.type).to.equal('number');
+        expect(age!.nulls![0]).to.equal(0b10);
+
+        expect(Array.from(networth!.data as Float64Array)).to.eql([1.5, 2.5]);
+        expect(nickname!.type).to.equal('null');
+      });
+
+      it('Cursor reads rows in chunks', async () => {
+        await db.executeBatch([
+          [
+            'INSERT INTO User (id, name, age, networth) VALUES(?, ?, ?, ?)',
+            Array.from({length: 250}, (_, i) => [i, `user ${i}`, i, i]),
+          ],
+        ]);
+
+        const cursor = db.openCursor(
+          'SELECT id, name FROM User WHERE id >= ? ORDER BY id',
+          [10],
+        );
+
+        const first = await cursor.next();
+        expect(first.rows.length).to.equal(100);
+        expect(first.rows[0]).to.eql({id: 10, name: 'user 10'});
+        expect(first.done).to.equal(false);
+
+        const second = await cursor.next(200);
+        expect(second.rows.length).to.equal(140);
+        expect(second.done).to.equal(true);
+
+        const last = await cursor.next();
+        expect(last.rows.length).to.equal(0);
+        expect(last.done).to.equal(true);
+
+        let count = 0;
+        for await (const row of db.openCursor('SELECT id FROM User')) {
+          expect(row.id).to.equal(count);
+          count++;
+        }
+        expect(count).to.equal(250);
+      });
+
+      it('Cursor rejects once the database is closed', async () => {
+        const other = open({name: 'cursorClose.sqlite', encryptionKey: 'test'});
+        await other.execute('CREATE TABLE IF NOT EXISTS T (id INT)');
+        await other.execute('INSERT INTO T VALUES (1), (2)');
+
+        const cursor = other.openCursor('SELECT id FROM T');
+        await cursor.next(1);
+        other.delete();
+
+        let error: unknown;
+        try {
+          await cursor.next();
+        } catch (e) {
+          error = e;
+        }
+        expect(error).to.be.instanceOf(Error);
+      });
+    }
+
     it('Create fts5 virtual table', async () => {
       await db.execute(
         'CREATE VIRTUAL TABLE fts5_table USING fts5(name, content);',
@@ -700,6 +1047,19 @@ export function queriesTests() {
       expect(res.rows).to.eql([{name: 'test', content: 'test content'}]);
     });
 
+    it('Execute returns rawRows when asked to', async () => {
+      await db.execute('INSERT INTO User (id, name) VALUES (?, ?)', [1, 'a']);
+
+      const res = await db.execute('SELECT id, name FROM User', [], {
+        rawRows: true,
+      });
+      expect(res.rows).to.eql([{id: 1, name: 'a'}]);
+      expect(res.rawRows).to.eql([[1, 'a']]);
+
+      const plain = await db.execute('SELECT id, name FROM User');
+      expect(plain.rawRows).to.equal(undefined);
+    });
+
     it('Various queries', async () => {
       await db.execute('SELECT 1 ');
       await db.execute('SELECT 1       ');
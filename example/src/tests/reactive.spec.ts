@@ -128,6 +128,42 @@ export function reactiveTests() {
       expect(emittedCount).to.eq(1);
     });
 
+    it('Reactive query without fireOn tracks the columns it reads', async () => {
+      let emittedCount = 0;
+      const unsubscribe = db.reactiveExecute({
+        query: 'SELECT name FROM User;',
+        arguments: [],
+        callback: () => {
+          emittedCount++;
+        },
+      });
+
+      await db.transaction(async tx => {
+        await tx.execute(
+          'INSERT INTO User (id, name, age, networth, nickname) VALUES (?, ?, ?, ?, ?);',
+          [1, 'John', 30, 1000, 'Johnny'],
+        );
+      });
+
+      await sleep(20);
+
+      await db.transaction(async tx => {
+        await tx.execute('UPDATE User SET age = ? WHERE id = ?;', [31, 1]);
+      });
+
+      await sleep(20);
+      expect(emittedCount).to.eq(1);
+
+      await db.transaction(async tx => {
+        await tx.execute('UPDATE User SET name = ? WHERE id = ?;', ['Foo', 1]);
+      });
+
+      await sleep(20);
+      expect(emittedCount).to.eq(2);
+
+      unsubscribe();
+    });
+
     it('Row reactive query', async () => {
       let firstReactiveRan = false;
       let secondReactiveRan = false;
@@ -199,6 +235,105 @@ export function reactiveTests() {
       unsubscribe3();
     });
 
+    it('Reactive query fires on writes outside of transactions', async () => {
+      let emittedUser = null;
+      const unsubscribe = db.reactiveExecute({
+        query: 'SELECT name FROM User;',
+        arguments: [],
+        fireOn: [{table: 'User'}],
+        callback: data => {
+          emittedUser = data.rows[0];
+        },
+      });
+
+      await db.execute('INSERT INTO User (id, name) VALUES (?, ?);', [
+        1,
+        'John',
+      ]);
+
+      await sleep(20);
+
+      expect(emittedUser).to.deep.eq({
+        name: 'John',
+      });
+
+      unsubscribe();
+    });
+
+    it('Keyed reactive query only emits the changed rows', async () => {
+      const emitted: any[] = [];
+      const unsubscribe = db.reactiveExecute({
+        query: 'SELECT id, name FROM User;',
+        arguments: [],
+        key: 'id',
+        callback: data => {
+          emitted.push(data);
+        },
+      });
+
+      await db.transaction(async tx => {
+        await tx.execute('INSERT INTO User (id, name) VALUES (?, ?), (?, ?);', [
+          1,
+          'John',
+          2,
+          'Jane',
+        ]);
+      });
+
+      await sleep(20);
+
+      await db.transaction(async tx => {
+        await tx.execute('UPDATE User SET name = ? WHERE id = ?;', ['Foo', 1]);
+        await tx.execute('DELETE FROM User WHERE id = ?;', [2]);
+      });
+
+      await sleep(20);
+
+      // age is not part of the result, nothing to emit
+      await db.transaction(async tx => {
+        await tx.execute('UPDATE User SET age = ? WHERE id = ?;', [40, 1]);
+      });
+
+      await sleep(20);
+
+      expect(emitted.length).to.eq(2);
+      expect(emitted[0].inserted.length).to.eq(2);
+      expect(emitted[1].inserted.length).to.eq(0);
+      expect(emitted[1].updated.length).to.eq(1);
+      expect(emitted[1].updated[0].name).to.eq('Foo');
+      expect(emitted[1].removed).to.deep.eq([2]);
+
+      unsubscribe();
+    });
+
+    it('Reactive query coalesces close commits', async () => {
+      let emittedCount = 0;
+      const unsubscribe = db.reactiveExecute({
+        query: 'SELECT * FROM User;',
+        arguments: [],
+        fireOn: [{table: 'User'}],
+        coalesceMs: 50,
+        callback: () => {
+          emittedCount++;
+        },
+      });
+
+      for (let i = 1; i <= 3; i++) {
+        await db.transaction(async tx => {
+          await tx.execute('INSERT INTO User (id, name) VALUES (?, ?);', [
+            i,
+            chance.name(),
+          ]);
+        });
+      }
+
+      await sleep(100);
+
+      expect(emittedCount).to.eq(1);
+
+      unsubscribe();
+    });
+
     it('Update hook and reactive queries work at the same time', async () => {
       let promiseResolve: any;
       let promise = new Promise(resolve => {
@@ -23,7 +23,7 @@ export type QueryResult = {
   rowsAffected: number;
   res?: any[];
   rows: Array<Record<string, Scalar>>;
-  // An array of intermediate results, just values without column names
+  // The rows as arrays of values, only returned by execute with the rawRows option
   rawRows?: Scalar[][];
   columnNames?: string[];
   /**
@@ -56,6 +56,97 @@ export type SQLBatchTuple = [string] | [string, Array<any> | Array<Array<any>>];
 
 export type UpdateHookOperation = 'INSERT' | 'DELETE' | 'UPDATE';
 
+// Indexed by the operation codes of the native update hook batches
+const UPDATE_HOOK_OPERATIONS: UpdateHookOperation[] = [
+  'INSERT',
+  'DELETE',
+  'UPDATE',
+];
+
+// Row ids outside of this range are passed as bigint, a number would round them
+const MAX_SAFE_ROW_ID = BigInt(Number.MAX_SAFE_INTEGER);
+const MIN_SAFE_ROW_ID = -MAX_SAFE_ROW_ID;
+
+/**
+ * Row change captured by changeHook. oldValues is missing on inserts and
+ * newValues on deletes, both only hold the captured columns
+ */
+export type ChangeEvent = {
+  table: string;
+  operation: UpdateHookOperation;
+  rowId: number;
+  oldValues?: Record<string, Scalar>;
+  newValues?: Record<string, Scalar>;
+};
+
+/**
+ * tables restricts the capture to the given tables, and to the given columns of each of them
+ * bufferSize is the max number of changes kept per transaction, the oldest ones are dropped past it
+ */
+export type ChangeHookOptions = {
+  tables?: { table: string; columns?: string[] }[];
+  bufferSize?: number;
+};
+
+/**
+ * Records the changes made to some tables so they can be sent to another database
+ */
+export type Session = {
+  /**
+   * Also records the changes of the given table, of every table when omitted
+   */
+  attach: (table?: string) => void;
+  isEmpty: () => boolean;
+  /**
+   * Changes recorded since the session was created, to be given to applyChangeset
+   */
+  changeset: () => Promise<ArrayBuffer>;
+  /**
+   * Smaller than a changeset as it only holds the new values of updated rows, conflicts on them cannot be detected
+   */
+  patchset: () => Promise<ArrayBuffer>;
+  close: () => Promise<void>;
+};
+
+/**
+ * Change of a changeset that could not be applied as is. Values are in column order and null where the changeset does not have them.
+ * foreignKey conflicts are reported once the whole changeset is applied and have no table nor values
+ */
+export type ChangesetConflict = {
+  type: 'data' | 'notfound' | 'conflict' | 'constraint' | 'foreignKey';
+  table?: string;
+  operation?: UpdateHookOperation;
+  oldValues?: Scalar[];
+  newValues?: Scalar[];
+  conflictingValues?: Scalar[];
+};
+
+/**
+ * omit skips the change, replace overwrites the conflicting row (only on data and conflict conflicts) and abort rolls back the whole changeset
+ */
+export type ChangesetConflictAction = 'omit' | 'replace' | 'abort';
+
+export type ApplyChangesetOptions = {
+  /**
+   * An action for every conflict, or a callback deciding on each of them. abort by default
+   */
+  onConflict?:
+    | ChangesetConflictAction
+    | ((conflict: ChangesetConflict) => ChangesetConflictAction);
+};
+
+/**
+ * Update hook events of a transaction as sent by the native side. Event i
+ * happened on tables[tableIds[i]], tableIds is a Uint32Array, operations a
+ * Uint8Array and rowIds a BigInt64Array
+ */
+type NativeUpdateHookBatch = {
+  tables: string[];
+  tableIds: ArrayBuffer;
+  operations: ArrayBuffer;
+  rowIds: ArrayBuffer;
+};
+
 /**
  * status: 0 or undefined for correct execution, 1 for error
  * message: if status === 1, here you will find error description
@@ -73,10 +164,116 @@ export type FileLoadResult = BatchQueryResult & {
   commands?: number;
 };
 
+/**
+ * Column returned by executeColumnar
+ * - number: data is a Float64Array with one value per row
+ * - bigint: integers that do not fit in a JS number, data is a BigInt64Array
+ * - text: data is a Uint8Array with the UTF-8 bytes of all the rows, row i spans from offsets[i] to offsets[i + 1]
+ * - blob: same layout as text but with the raw bytes
+ * - mixed: columns with values of different types, values is a regular array
+ * - null: every value is NULL
+ *
+ * Bit i of nulls (nulls[i >> 3] & (1 << (i & 7))) is set when row i is NULL, it is undefined if no row is NULL
+ */
+export type ColumnarColumn = {
+  name: string;
+  type: 'number' | 'bigint' | 'text' | 'blob' | 'mixed' | 'null';
+  data?: Float64Array | BigInt64Array | Uint8Array;
+  offsets?: Uint32Array;
+  nulls?: Uint8Array;
+  values?: Scalar[];
+};
+
+export type ColumnarResult = {
+  insertId?: number;
+  rowsAffected: number;
+  /** Number of rows */
+  length: number;
+  columns: ColumnarColumn[];
+};
+
+/**
+ * Query results kept in native memory, rows are only converted to JS when read
+ */
+export type ResultSet = {
+  /** Number of rows, 0 once the result set has been freed */
+  length: number;
+  rowsAffected: number;
+  insertId?: number;
+  columnNames: string[];
+  getRow: (index: number) => Record<string, Scalar>;
+  /**
+   * @param column index or name of the column
+   */
+  getValue: (index: number, column: number | string) => Scalar;
+  /**
+   * Releases the native memory right away instead of waiting for the garbage collector
+   */
+  free: () => void;
+};
+
+/**
+ * Lane a query is queued in, interactive queries run before normal ones and normal before background
+ * A lower lane still gets a turn after being passed over a few times in a row
+ */
+export type Priority = 'interactive' | 'normal' | 'background';
+
+export type QueryOptions = {
+  /** Defaults to normal */
+  priority?: Priority;
+  /**
+   * The query is rejected if it has not finished after this many milliseconds.
+   * Queries still waiting in the queue are dropped without running
+   */
+  timeoutMs?: number;
+  /**
+   * execute also returns the rows as arrays of values in rawRows
+   */
+  rawRows?: boolean;
+};
+
+/**
+ * Promise of a query that can be cancelled. A query waiting in the queue is
+ * dropped, a running one is interrupted, either way the promise rejects
+ */
+export type CancellablePromise<T> = Promise<T> & { cancel: () => void };
+
+/**
+ * Number of queries waiting to run in each lane
+ */
+export type QueueStats = Record<Priority, number>;
+
+/**
+ * Counters of the per connection prepared statement cache
+ */
+export type StatementCacheStats = {
+  hits: number;
+  misses: number;
+  /** Number of statements currently cached */
+  size: number;
+  /** Max number of statements that can be cached */
+  capacity: number;
+};
+
 export type Transaction = {
   commit: () => Promise<QueryResult>;
   execute: (query: string, params?: Scalar[]) => Promise<QueryResult>;
   rollback: () => Promise<QueryResult>;
+  /**
+   * Runs fn inside a savepoint. If it throws, only the changes made inside
+   * the savepoint are rolled back and the error is rethrown.
+   * Calling commit or rollback on the nested transaction releases or rolls back the savepoint
+   */
+  savepoint: (fn: (tx: Transaction) => Promise<void>) => Promise<void>;
+};
+
+type NativeTransaction = {
+  execute: (query: string, params?: Scalar[]) => Promise<QueryResult>;
+  savepoint: () => void;
+  release: () => Promise<QueryResult>;
+  rollbackToSavepoint: () => Promise<QueryResult>;
+  commit: () => Promise<QueryResult>;
+  rollback: () => Promise<QueryResult>;
 };
 
 type PendingTransaction = {
@@ -95,6 +292,45 @@ type PendingTransaction = {
 export type PreparedStatement = {
   bind: (params: any[]) => Promise<void>;
   execute: () => Promise<QueryResult>;
+  /**
+   * Binds the params and executes the statement in a single round trip, the values bound before are kept when params is omitted
+   */
+  run: (params?: Scalar[]) => Promise<QueryResult>;
+  /**
+   * Same as run but the rows are arrays of values, see executeRaw
+   */
+  runRaw: (params?: Scalar[]) => Promise<any[]>;
+  /**
+   * Same as run but blocks the JS thread, only use it for quick lookups
+   */
+  runSync: (params?: Scalar[]) => QueryResult;
+  /**
+   * Runs the statement once per set of params, all of them are written or none. Returned rows are discarded
+   */
+  runMany: (params: Scalar[][]) => Promise<{ rowsAffected: number }>;
+};
+
+export type CursorResult = {
+  rows: Record<string, Scalar>[];
+  /** True once the query has no more rows, the cursor is closed automatically */
+  done: boolean;
+};
+
+export type Cursor = {
+  /**
+   * Reads the next chunk of rows, 100 by default
+   */
+  next: (count?: number) => Promise<CursorResult>;
+  /**
+   * Releases the underlying statement, only needed if you stop reading before the cursor is done
+   */
+  close: () => Promise<void>;
+  [Symbol.asyncIterator]: () => AsyncIterator<Record<string, Scalar>>;
+};
+
+type NativeCursor = {
+  next: (count?: number) => Promise<any>;
+  close: () => Promise<void>;
 };
 
 type InternalDB = {
@@ -108,41 +344,73 @@ type InternalDB = {
   ) => void;
   detach: (mainDbName: string, alias: string) => void;
   transaction: (fn: (tx: Transaction) => Promise<void>) => Promise<void>;
+  beginTransaction: () => NativeTransaction;
   executeSync: (query: string, params?: Scalar[]) => QueryResult;
-  execute: (query: string, params?: Scalar[]) => Promise<QueryResult>;
+  execute: (
+    query: string,
+    params?: Scalar[],
+    options?: QueryOptions
+  ) => CancellablePromise<QueryResult>;
   executeWithHostObjects: (
     query: string,
-    params?: Scalar[]
-  ) => Promise<QueryResult>;
-  executeBatch: (commands: SQLBatchTuple[]) => Promise<BatchQueryResult>;
+    params?: Scalar[],
+    options?: QueryOptions
+  ) => CancellablePromise<QueryResult>;
+  executeResultSet: (
+    query: string,
+    params?: Scalar[],
+    options?: QueryOptions
+  ) => CancellablePromise<ResultSet>;
+  executeBatch: (
+    commands: SQLBatchTuple[],
+    options?: QueryOptions
+  ) => CancellablePromise<BatchQueryResult>;
   loadFile: (location: string) => Promise<FileLoadResult>;
   updateHook: (
-    callback?:
-      | ((params: {
-          table: string;
-          operation: UpdateHookOperation;
-          row?: any;
-          rowId: number;
-        }) => void)
-      | null
+    callback?: ((batch: NativeUpdateHookBatch) => void) | null
   ) => void;
   commitHook: (callback?: (() => void) | null) => void;
   rollbackHook: (callback?: (() => void) | null) => void;
+  changeHook: (
+    callback?:
+      | ((batch: { changes: ChangeEvent[]; dropped: number }) => void)
+      | null,
+    options?: ChangeHookOptions
+  ) => void;
+  createSession: (tables?: string[]) => Session;
+  applyChangeset: (
+    changeset: ArrayBuffer,
+    options?: ApplyChangesetOptions
+  ) => Promise<void>;
   prepareStatement: (query: string) => PreparedStatement;
   loadExtension: (path: string, entryPoint?: string) => void;
-  executeRaw: (query: string, params?: Scalar[]) => Promise<any[]>;
+  executeRaw: (
+    query: string,
+    params?: Scalar[],
+    options?: QueryOptions
+  ) => CancellablePromise<any[]>;
+  executeColumnar: (
+    query: string,
+    params?: Scalar[],
+    options?: QueryOptions
+  ) => CancellablePromise<any>;
+  openCursor: (query: string, params?: Scalar[]) => NativeCursor;
   getDbPath: (location?: string) => string;
   reactiveExecute: (params: {
     query: string;
     arguments: any[];
-    fireOn: {
+    fireOn?: {
       table: string;
       ids?: number[];
     }[];
+    key?: string;
+    coalesceMs?: number;
     callback: (response: any) => void;
   }) => () => void;
   sync: () => void;
   flushPendingReactiveQueries: () => Promise<void>;
+  getStatementCacheStats: () => StatementCacheStats;
+  getQueueStats: () => QueueStats;
 };
 
 export type DB = {
@@ -201,7 +469,11 @@ export type DB = {
    * @param params a list of parameters to bind to the query, if any
    * @returns Promise<QueryResult> with the result of the query
    */
-  execute: (query: string, params?: Scalar[]) => Promise<QueryResult>;
+  execute: (
+    query: string,
+    params?: Scalar[],
+    options?: QueryOptions
+  ) => CancellablePromise<QueryResult>;
   /**
    * Similar to the execute function but returns the response in HostObjects
    * Read more about HostObjects in the documentation and their pitfalls
@@ -214,8 +486,22 @@ export type DB = {
    */
   executeWithHostObjects: (
     query: string,
-    params?: Scalar[]
-  ) => Promise<QueryResult>;
+    params?: Scalar[],
+    options?: QueryOptions
+  ) => CancellablePromise<QueryResult>;
+  /**
+   * Same as `execute` but the rows stay in native memory and are only converted when you read them
+   * Useful for large results where only a window is rendered at a time, e.g. virtualized lists
+   *
+   * @param query
+   * @param params
+   * @returns Promise<ResultSet>
+   */
+  executeResultSet: (
+    query: string,
+    params?: Scalar[],
+    options?: QueryOptions
+  ) => CancellablePromise<ResultSet>;
   /**
    * Executes all the queries in the params inside a single transaction
    *
@@ -223,7 +509,10 @@ export type DB = {
    * @param commands
    * @returns Promise<BatchQueryResult>
    */
-  executeBatch: (commands: SQLBatchTuple[]) => Promise<BatchQueryResult>;
+  executeBatch: (
+    commands: SQLBatchTuple[],
+    options?: QueryOptions
+  ) => CancellablePromise<BatchQueryResult>;
   /**
    * Loads a SQLite Dump from disk. It will be the fastest way to execute a large set of queries as no JS is involved
    */
@@ -234,12 +523,39 @@ export type DB = {
           table: string;
           operation: UpdateHookOperation;
           row?: any;
-          rowId: number;
+          /**
+           * A bigint when it does not fit in a JS number
+           */
+          rowId: number | bigint;
         }) => void)
       | null
   ) => void;
   commitHook: (callback?: (() => void) | null) => void;
   rollbackHook: (callback?: (() => void) | null) => void;
+  /**
+   * Change data capture. Receives the old and new values of every row changed by a transaction, in one batch when it commits.
+   * dropped is the number of changes lost because the transaction did not fit in bufferSize.
+   * Not available on libsql and the iOS embedded version
+   */
+  changeHook: (
+    callback?:
+      | ((batch: { changes: ChangeEvent[]; dropped: number }) => void)
+      | null,
+    options?: ChangeHookOptions
+  ) => void;
+  /**
+   * Starts recording the changes made to the given tables, to every table when omitted.
+   * Not available on libsql and the iOS embedded version
+   */
+  createSession: (tables?: string[]) => Session;
+  /**
+   * Applies a changeset or a patchset in a single transaction. The promise rejects and nothing is applied when a conflict aborts.
+   * An onConflict callback is called once the conflicts are known and the changeset applied again with its answers, it can query the database
+   */
+  applyChangeset: (
+    changeset: ArrayBuffer,
+    options?: ApplyChangesetOptions
+  ) => Promise<void>;
   /**
    * Constructs a prepared statement from the query string
    * The statement can be re-bound with parameters and executed
@@ -259,7 +575,27 @@ export type DB = {
    * Same as `execute` except the results are not returned in objects but rather in arrays with just the values and not the keys
    * It will be faster since a lot of repeated work is skipped and only the values you care about are returned
    */
-  executeRaw: (query: string, params?: Scalar[]) => Promise<any[]>;
+  executeRaw: (
+    query: string,
+    params?: Scalar[],
+    options?: QueryOptions
+  ) => CancellablePromise<any[]>;
+  /**
+   * Returns the results column by column, each column in a single typed array instead of one JS value per cell
+   * Meant for large result sets (analytics, charts, exports) where creating millions of JS values is the bottleneck
+   * Not available in libsql
+   */
+  executeColumnar: (
+    query: string,
+    params?: Scalar[],
+    options?: QueryOptions
+  ) => CancellablePromise<ColumnarResult>;
+  /**
+   * Opens a cursor that reads the results in chunks instead of loading all of them in memory at once
+   * The query is only run when the first chunk is requested
+   * Not available in libsql
+   */
+  openCursor: (query: string, params?: Scalar[]) => Cursor;
   /**
    * Get's the absolute path to the db file. Useful for debugging on local builds and for attaching the DB from users devices
    */
@@ -270,10 +606,12 @@ export type DB = {
   reactiveExecute: (params: {
     query: string;
     arguments: any[];
-    fireOn: {
+    fireOn?: {
       table: string;
       ids?: number[];
     }[];
+    key?: string;
+    coalesceMs?: number;
     callback: (response: any) => void;
   }) => () => void;
   /** This function is only available for libsql.
@@ -284,6 +622,16 @@ export type DB = {
    * The database is hosted in turso
    **/
   sync: () => void;
+  /**
+   * Single statement queries passed to execute, executeRaw and executeWithHostObjects
+   * are prepared once and then cached per connection. Returns the hit/miss counters of that cache.
+   * Not available in libsql
+   */
+  getStatementCacheStats: () => StatementCacheStats;
+  /**
+   * Number of queries waiting to run on this database in each priority lane
+   */
+  getQueueStats: () => QueueStats;
 };
 
 export type DBParams = {
@@ -299,6 +647,8 @@ export type OPSQLiteProxy = {
     name: string;
     location?: string;
     encryptionKey?: string;
+    statementCacheSize?: number;
+    readers?: number;
   }) => InternalDB;
   openRemote: (options: { url: string; authToken: string }) => InternalDB;
   openSync: (options: DBParams) => InternalDB;
@@ -347,6 +697,85 @@ export const {
   ? NativeModules.OPSQLite.getConstants()
   : NativeModules.OPSQLite;
 
+/**
+ * Runs fn against a transaction, or a savepoint of one. Statements are queued
+ * on the database thread as they are called, end commits or rolls back once
+ * fn is done
+ */
+async function runNativeTransaction(
+  nativeTx: NativeTransaction,
+  fn: (tx: Transaction) => Promise<void>,
+  end: {
+    commit: () => Promise<QueryResult>;
+    rollback: () => Promise<QueryResult>;
+  },
+  dbName: string
+): Promise<void> {
+  let isFinalized = false;
+
+  const checkNotFinalized = () => {
+    if (isFinalized) {
+      throw Error(
+        `OP-Sqlite Error: Database: ${dbName}. Cannot execute query on finalized transaction`
+      );
+    }
+  };
+
+  const tx: Transaction = {
+    execute: async (query: string, params?: Scalar[]) => {
+      checkNotFinalized();
+
+      const sanitizedParams = params?.map((p) => {
+        if (ArrayBuffer.isView(p)) {
+          return p.buffer;
+        }
+
+        return p;
+      });
+
+      return await nativeTx.execute(query, sanitizedParams as Scalar[]);
+    },
+    commit: async () => {
+      checkNotFinalized();
+      isFinalized = true;
+      return await end.commit();
+    },
+    rollback: async () => {
+      checkNotFinalized();
+      isFinalized = true;
+      return await end.rollback();
+    },
+    savepoint: async (nestedFn: (tx: Transaction) => Promise<void>) => {
+      checkNotFinalized();
+      nativeTx.savepoint();
+
+      await runNativeTransaction(
+        nativeTx,
+        nestedFn,
+        {
+          commit: nativeTx.release,
+          rollback: nativeTx.rollbackToSavepoint,
+        },
+        dbName
+      );
+    },
+  };
+
+  try {
+    await fn(tx);
+
+    if (!isFinalized) {
+      await tx.commit();
+    }
+  } catch (executionError) {
+    if (!isFinalized) {
+      await tx.rollback();
+    }
+
+    throw executionError;
+  }
+}
+
 function enhanceDB(db: InternalDB, options: DBParams): DB {
   const lock = {
     queue: [] as PendingTransaction[],
@@ -381,19 +810,58 @@ function enhanceDB(db: InternalDB, options: DBParams): DB {
     detach: db.detach,
     executeBatch: db.executeBatch,
     loadFile: db.loadFile,
-    updateHook: db.updateHook,
+    updateHook: (
+      callback?:
+        | ((params: {
+            table: string;
+            operation: UpdateHookOperation;
+            row?: any;
+            rowId: number | bigint;
+          }) => void)
+        | null
+    ) => {
+      if (!callback) {
+        db.updateHook(callback);
+        return;
+      }
+
+      // The events of a transaction come in one batch when it commits
+      db.updateHook((batch: NativeUpdateHookBatch) => {
+        const tableIds = new Uint32Array(batch.tableIds);
+        const operations = new Uint8Array(batch.operations);
+        const rowIds = new BigInt64Array(batch.rowIds);
+
+        for (let i = 0; i < rowIds.length; i++) {
+          const rowId = rowIds[i]!;
+          callback({
+            table: batch.tables[tableIds[i]!]!,
+            operation: UPDATE_HOOK_OPERATIONS[operations[i]!]!,
+            rowId:
+              rowId >= MIN_SAFE_ROW_ID && rowId <= MAX_SAFE_ROW_ID
+                ? Number(rowId)
+                : rowId,
+          });
+        }
+      });
+    },
     commitHook: db.commitHook,
     rollbackHook: db.rollbackHook,
+    changeHook: db.changeHook,
+    createSession: db.createSession,
+    applyChangeset: db.applyChangeset,
     loadExtension: db.loadExtension,
     executeRaw: db.executeRaw,
     getDbPath: db.getDbPath,
     reactiveExecute: db.reactiveExecute,
     sync: db.sync,
+    getStatementCacheStats: db.getStatementCacheStats,
+    getQueueStats: db.getQueueStats,
     close: db.close,
-    executeWithHostObjects: async (
+    executeColumnar: (
       query: string,
-      params?: Scalar[]
-    ): Promise<QueryResult> => {
+      params?: Scalar[],
+      options?: QueryOptions
+    ): CancellablePromise<ColumnarResult> => {
       const sanitizedParams = params?.map((p) => {
         if (ArrayBuffer.isView(p)) {
           return p.buffer;
@@ -402,11 +870,41 @@ function enhanceDB(db: InternalDB, options: DBParams): DB {
         return p;
       });
 
-      return sanitizedParams
-        ? await db.executeWithHostObjects(query, sanitizedParams as Scalar[])
-        : await db.executeWithHostObjects(query);
+      const promise = db.executeColumnar(
+        query,
+        sanitizedParams as Scalar[],
+        options
+      );
+
+      const columnar = promise.then((result) => {
+        const columns: ColumnarColumn[] = result.columns.map((column: any) => {
+          let data: ColumnarColumn['data'];
+          if (column.type === 'number') {
+            data = new Float64Array(column.data);
+          } else if (column.type === 'bigint') {
+            data = new BigInt64Array(column.data);
+          } else if (column.type === 'text' || column.type === 'blob') {
+            data = new Uint8Array(column.data);
+          }
+
+          return {
+            name: column.name,
+            type: column.type,
+            data,
+            offsets: column.offsets
+              ? new Uint32Array(column.offsets)
+              : undefined,
+            nulls: column.nulls ? new Uint8Array(column.nulls) : undefined,
+            values: column.values,
+          };
+        });
+
+        return { ...result, columns };
+      });
+
+      return Object.assign(columnar, { cancel: promise.cancel });
     },
-    executeSync: (query: string, params?: Scalar[]): QueryResult => {
+    openCursor: (query: string, params?: Scalar[]): Cursor => {
       const sanitizedParams = params?.map((p) => {
         if (ArrayBuffer.isView(p)) {
           return p.buffer;
@@ -415,36 +913,67 @@ function enhanceDB(db: InternalDB, options: DBParams): DB {
         return p;
       });
 
-      let intermediateResult = sanitizedParams
-        ? db.executeSync(query, sanitizedParams as Scalar[])
-        : db.executeSync(query);
+      const cursor = sanitizedParams
+        ? db.openCursor(query, sanitizedParams as Scalar[])
+        : db.openCursor(query);
 
-      let rows: Record<string, Scalar>[] = [];
-      for (let i = 0; i < (intermediateResult.rawRows?.length ?? 0); i++) {
-        let row: Record<string, Scalar> = {};
-        let rawRow = intermediateResult.rawRows![i]!;
-        for (let j = 0; j < intermediateResult.columnNames!.length; j++) {
-          let columnName = intermediateResult.columnNames![j]!;
-          let value = rawRow[j]!;
+      const next = async (count?: number): Promise<CursorResult> => {
+        const result =
+          count !== undefined ? await cursor.next(count) : await cursor.next();
 
-          row[columnName] = value;
-        }
-        rows.push(row);
-      }
+        return { rows: result.rows, done: result.done };
+      };
 
-      let res = {
-        ...intermediateResult,
-        rows,
+      return {
+        next,
+        close: cursor.close,
+        [Symbol.asyncIterator]: () => {
+          let buffered: Record<string, Scalar>[] = [];
+          let index = 0;
+          let done = false;
+
+          return {
+            next: async () => {
+              while (index >= buffered.length) {
+                if (done) {
+                  return { done: true, value: undefined } as const;
+                }
+                const chunk = await next();
+                buffered = chunk.rows;
+                index = 0;
+                done = chunk.done;
+              }
+
+              return { done: false, value: buffered[index++]! } as const;
+            },
+            return: async () => {
+              await cursor.close();
+              return { done: true, value: undefined } as const;
+            },
+          };
+        },
       };
+    },
+    executeWithHostObjects: (
+      query: string,
+      params?: Scalar[],
+      options?: QueryOptions
+    ): CancellablePromise<QueryResult> => {
+      const sanitizedParams = params?.map((p) => {
+        if (ArrayBuffer.isView(p)) {
+          return p.buffer;
+        }
 
-      delete res.rawRows;
+        return p;
+      });
 
-      return res;
+      return db.executeWithHostObjects(query, sanitizedParams as Scalar[], options);
     },
-    execute: async (
+    executeResultSet: (
       query: string,
-      params?: Scalar[] | undefined
-    ): Promise<QueryResult> => {
+      params?: Scalar[],
+      options?: QueryOptions
+    ): CancellablePromise<ResultSet> => {
       const sanitizedParams = params?.map((p) => {
         if (ArrayBuffer.isView(p)) {
           return p.buffer;
@@ -453,36 +982,48 @@ function enhanceDB(db: InternalDB, options: DBParams): DB {
         return p;
       });
 
-      let intermediateResult = await db.execute(
-        query,
-        sanitizedParams as Scalar[]
-      );
+      return db.executeResultSet(query, sanitizedParams as Scalar[], options);
+    },
+    executeSync: (query: string, params?: Scalar[]): QueryResult => {
+      const sanitizedParams = params?.map((p) => {
+        if (ArrayBuffer.isView(p)) {
+          return p.buffer;
+        }
 
-      let rows: Record<string, Scalar>[] = [];
-      for (let i = 0; i < (intermediateResult.rawRows?.length ?? 0); i++) {
-        let row: Record<string, Scalar> = {};
-        let rawRow = intermediateResult.rawRows![i]!;
-        for (let j = 0; j < intermediateResult.columnNames!.length; j++) {
-          let columnName = intermediateResult.columnNames![j]!;
-          let value = rawRow[j]!;
+        return p;
+      });
 
-          row[columnName] = value;
+      return sanitizedParams
+        ? db.executeSync(query, sanitizedParams as Scalar[])
+        : db.executeSync(query);
+    },
+    execute: (
+      query: string,
+      params?: Scalar[] | undefined,
+      options?: QueryOptions
+    ): CancellablePromise<QueryResult> => {
+      const sanitizedParams = params?.map((p) => {
+        if (ArrayBuffer.isView(p)) {
+          return p.buffer;
         }
-        rows.push(row);
-      }
 
-      let res = {
-        ...intermediateResult,
-        rows,
-      };
-
-      delete res.rawRows;
+        return p;
+      });
 
-      return res;
+      return db.execute(query, sanitizedParams as Scalar[], options);
     },
     prepareStatement: (query: string) => {
       const stmt = db.prepareStatement(query);
 
+      const sanitizeStatementParams = (params?: Scalar[]) =>
+        params?.map((p) => {
+          if (ArrayBuffer.isView(p)) {
+            return p.buffer;
+          }
+
+          return p;
+        }) as Scalar[] | undefined;
+
       return {
         bind: async (params: Scalar[]) => {
           const sanitizedParams = params.map((p) => {
@@ -496,11 +1037,30 @@ function enhanceDB(db: InternalDB, options: DBParams): DB {
           await stmt.bind(sanitizedParams);
         },
         execute: stmt.execute,
+        run: (params?: Scalar[]) => stmt.run(sanitizeStatementParams(params)),
+        runRaw: (params?: Scalar[]) =>
+          stmt.runRaw(sanitizeStatementParams(params)),
+        runSync: (params?: Scalar[]) =>
+          stmt.runSync(sanitizeStatementParams(params)),
+        runMany: (params: Scalar[][]) =>
+          stmt.runMany(params.map((p) => sanitizeStatementParams(p)!)),
       };
     },
     transaction: async (
       fn: (tx: Transaction) => Promise<void>
     ): Promise<void> => {
+      // Transactions are queued and serialized on the database thread
+      if (!isLibsql()) {
+        const nativeTx = db.beginTransaction();
+
+        return await runNativeTransaction(
+          nativeTx,
+          fn,
+          { commit: nativeTx.commit, rollback: nativeTx.rollback },
+          options.name || options.url || ''
+        );
+      }
+
       let isFinalized = false;
 
       const execute = async (query: string, params?: Scalar[]) => {
@@ -524,8 +1084,6 @@ function enhanceDB(db: InternalDB, options: DBParams): DB {
         }
         const result = await enhancedDb.execute('COMMIT;');
 
-        await db.flushPendingReactiveQueries();
-
         isFinalized = true;
         return result;
       };
@@ -543,6 +1101,48 @@ function enhanceDB(db: InternalDB, options: DBParams): DB {
         return result;
       };
 
+      // Savepoints go through execute, libsql has no native transaction
+      let depth = 0;
+      const savepoints: NativeTransaction = {
+        execute,
+        savepoint: () => {
+          depth++;
+          // A failed SAVEPOINT surfaces on the statements queued after it
+          enhancedDb.execute(`SAVEPOINT op_sqlite_${depth};`).catch(() => {});
+        },
+        release: () => enhancedDb.execute(`RELEASE op_sqlite_${depth--};`),
+        rollbackToSavepoint: async () => {
+          const name = `op_sqlite_${depth--}`;
+          await enhancedDb.execute(`ROLLBACK TO ${name};`);
+          return await enhancedDb.execute(`RELEASE ${name};`);
+        },
+        commit,
+        rollback,
+      };
+
+      const savepoint = async (
+        nestedFn: (tx: Transaction) => Promise<void>
+      ): Promise<void> => {
+        if (isFinalized) {
+          throw Error(
+            `OP-Sqlite Error: Database: ${
+              options.name || options.url
+            }. Cannot execute query on finalized transaction`
+          );
+        }
+        savepoints.savepoint();
+
+        await runNativeTransaction(
+          savepoints,
+          nestedFn,
+          {
+            commit: savepoints.release,
+            rollback: savepoints.rollbackToSavepoint,
+          },
+          options.name || options.url || ''
+        );
+      };
+
       async function run() {
         try {
           await enhancedDb.execute('BEGIN TRANSACTION;');
@@ -551,6 +1151,7 @@ function enhanceDB(db: InternalDB, options: DBParams): DB {
             commit,
             execute,
             rollback,
+            savepoint,
           });
 
           if (!isFinalized) {
@@ -628,11 +1229,18 @@ export const openRemote = (params: { url: string; authToken: string }): DB => {
 /**
  * Open a connection to a local sqlite or sqlcipher database
  * If you want libsql remote or sync connections, use openSync or openRemote
+ *
+ * statementCacheSize is the max number of prepared statements kept per connection, 0 disables the cache
+ *
+ * readers is the number of extra read only connections (at most 16), reads run on them in parallel with writes.
+ * It switches the database to WAL mode and a read can run before a write you have not awaited. Not available on libsql
  */
 export const open = (params: {
   name: string;
   location?: string;
   encryptionKey?: string;
+  statementCacheSize?: number;
+  readers?: number;
 }): DB => {
   if (params.location?.startsWith('file://')) {
     console.warn(